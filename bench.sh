@@ -0,0 +1,20 @@
+#! /bin/bash
+
+# Generate synthetic programs and run all benchmarks on them, one JSON line per benchmark and input.
+# Benchmarks need an optimized build: OPT=0 ./build.sh
+
+set -e
+
+DATA=bench_data
+SIZE=${SIZE:-4000000}
+
+mkdir -p $DATA
+for shape in objects funcs globals mixed; do
+    if [ ! -f $DATA/$shape.owl ]; then
+        ./generate_owl.py --shape $shape --size $SIZE -o $DATA/$shape.owl
+    fi
+done
+
+find src -perm -111 -type f -name '*_bench' | sort | while read b; do
+    $b "$@" $DATA/*.owl
+done
@@ -11,6 +11,7 @@ NINJA_FILE = "ninja_build"
 BUILD_JSON = "BUILD.json"
 MAIN_TEST = "main_test.cpp"
 MAIN = "main.c"
+MAIN_FILES = ["main.c", "main.cpp"]
 
 
 cmdline_args = None
@@ -56,16 +57,19 @@ class Package:
 
         self.src_main = []
         self.src_test = []
+        self.src_bench = []
         for f in self.src_files:
             if f.find("_test.c") >= 0:
                 self.src_test.append(f)
+            elif f.find("_bench.c") >= 0:
+                self.src_bench.append(f)
             else:
                 self.src_main.append(f)
 
 
     def __repr__(self):
-        return "Package({} deps={} {}/{})".format(
-                self.name, self.deps, self.src_main, self.src_test)
+        return "Package({} deps={} {}/{}/{})".format(
+                self.name, self.deps, self.src_main, self.src_test, self.src_bench)
 
 
 class NinjaFile:
@@ -96,8 +100,7 @@ class NinjaFile:
 
 
         def build_ld(self, pkg, is_test, src_files, deps, libs):
-            deps.reverse()
-            expand_deps = [lib_name(l) for l in deps]
+            expand_deps = [lib_name(l) for l in reversed(deps)]
             bin_name = pkg + "_test" if is_test else pkg
             self.fo.write("build {}/{}: ld {} {}\n".format(
                     pkg,
@@ -109,6 +112,20 @@ class NinjaFile:
                         ' '.join(["-l" + l for l in libs])))
 
 
+        # Every benchmark source is a binary of its own
+        def build_bench(self, pkg, bench_file, src_files, deps, libs):
+            expand_deps = [lib_name(l) for l in reversed(deps)]
+            bin_name = os.path.splitext(os.path.basename(bench_file))[0]
+            self.fo.write("build {}/{}: ld {} {}\n".format(
+                    pkg,
+                    bin_name,
+                    ' '.join([obj_name(f) for f in [bench_file] + src_files]),
+                    ' '.join(expand_deps)))
+            if len(libs) > 0:
+                self.fo.write("    libs = {}\n".format(
+                        ' '.join(["-l" + l for l in libs])))
+
+
         def end(self, pkg):
             self.fo.write("\n")
             pass
@@ -176,8 +193,22 @@ def write_package(p, nf):
     else:
         nf.build_ar(p.name, p.src_main)
 
+    # Binary packages have no library, tests link their sources except the entry point
     if p.is_test:
-        nf.build_ld(p.name, True, p.src_test, [p.name] + p.transitive_deps, ["gtest"] + libs)
+        if p.is_main:
+            src_files = [f for f in p.src_main if os.path.basename(f) not in MAIN_FILES]
+            nf.build_ld(p.name, True, p.src_test + src_files, p.transitive_deps,
+                    ["gtest"] + libs)
+        else:
+            nf.build_ld(p.name, True, p.src_test, [p.name] + p.transitive_deps, ["gtest"] + libs)
+
+    # Binary packages have no library, benchmarks link their sources except the entry point
+    for b in p.src_bench:
+        if p.is_main:
+            src_files = [f for f in p.src_main if os.path.basename(f) not in MAIN_FILES]
+            nf.build_bench(p.name, b, src_files, p.transitive_deps, libs)
+        else:
+            nf.build_bench(p.name, b, [], [p.name] + p.transitive_deps, libs)
 
     nf.end(p.name)
 
@@ -0,0 +1,135 @@
+#! /usr/bin/env python3
+
+import argparse
+import random
+import sys
+
+
+# Shapes of generated programs: (objects, fields per object, functions, global variables)
+SHAPES = {
+    "objects": (1000, 16, 10, 10),
+    "funcs": (10, 4, 1000, 10),
+    "globals": (10, 4, 10, 1000),
+    "mixed": (300, 8, 300, 300),
+}
+
+TYPES = ["int", "long", "float", "double", "bool", "byte"]
+
+
+cmdline_args = None
+
+
+def comment(rng, out):
+    if rng.random() < cmdline_args.comments:
+        out.append("# {}\n".format(" ".join(
+                "word{}".format(rng.randrange(1000)) for _ in range(rng.randrange(1, 10)))))
+
+
+# Field or variable definition
+def variable(rng, name, indent, out):
+    comment(rng, out)
+    text = indent
+    if rng.random() < 0.2:
+        text += "auto "
+    text += "var " + name
+    if rng.random() < 0.5:
+        text += ": " + rng.choice(TYPES)
+    if rng.random() < 0.5:
+        text += " = {}".format(rng.randrange(1000000))
+    out.append(text + ";\n")
+
+
+def object_def(rng, index, n_fields, out):
+    comment(rng, out)
+    out.append("object obj{} {{\n".format(index))
+    for i in range(n_fields):
+        variable(rng, "field{}".format(i), "    ", out)
+    out.append("}\n\n")
+
+
+def function(rng, index, out):
+    comment(rng, out)
+    out.append("func fn{}(): int {{\n".format(index))
+    for i in range(cmdline_args.statements):
+        comment(rng, out)
+        # Statements have no terminator in the grammar
+        out.append("    return {}\n".format(rng.randrange(1000000)))
+    out.append("}\n\n")
+
+
+# Generates one round of definitions of the shape, returns text
+def generate_round(rng, shape, round_index):
+    n_objects, n_fields, n_funcs, n_globals = shape
+    if cmdline_args.fields is not None:
+        n_fields = cmdline_args.fields
+
+    out = []
+    base = round_index * max(n_objects, n_funcs, n_globals)
+    for i in range(n_objects):
+        object_def(rng, base + i, n_fields, out)
+    for i in range(n_funcs):
+        function(rng, base + i, out)
+    for i in range(n_globals):
+        variable(rng, "global{}".format(base + i), "", out)
+    return "".join(out)
+
+
+def generate(out):
+    rng = random.Random(cmdline_args.seed)
+    shape = SHAPES[cmdline_args.shape]
+
+    # Repeat rounds with unique names until requested size is reached
+    size = 0
+    round_index = 0
+    while size < cmdline_args.size or round_index == 0:
+        text = generate_round(rng, shape, round_index)
+        out.write(text)
+        size += len(text)
+        round_index += 1
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description='Generate synthetic Owl program')
+    parser.add_argument(
+            '--shape',
+            choices=sorted(SHAPES.keys()),
+            default="mixed",
+            help='Kind of definitions that dominate the program')
+    parser.add_argument(
+            '--size',
+            type=int,
+            default=1 << 20,
+            help='Approximate size of the program in bytes')
+    parser.add_argument(
+            '--fields',
+            type=int,
+            default=None,
+            help='Fields per object (overrides shape)')
+    parser.add_argument(
+            '--statements',
+            type=int,
+            default=1,
+            help='Statements per function')
+    parser.add_argument(
+            '--comments',
+            type=float,
+            default=0.2,
+            help='Probability of a comment line before a definition')
+    parser.add_argument(
+            '--seed',
+            type=int,
+            default=1,
+            help='Random seed')
+    parser.add_argument(
+            '-o', '--output',
+            help='Output file (default: stdout)')
+
+    cmdline_args = parser.parse_args()
+
+    if cmdline_args.output:
+        with open(cmdline_args.output, 'w') as f:
+            generate(f)
+    else:
+        generate(sys.stdout)
+
+    sys.exit(0)
@@ -0,0 +1,52 @@
+#include "owl/arena.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace owl {
+
+static constexpr size_t ARENA_MIN_BLOCK = 64 * 1024;
+static constexpr size_t ARENA_MAX_BLOCK = 4 * 1024 * 1024;
+
+struct arena_block {
+    arena_block *next = nullptr;
+};
+
+arena::~arena()
+{
+    while (head) {
+        auto *next = head->next;
+        free(head);
+        head = next;
+    }
+}
+
+void *arena_alloc_slow(arena *a, size_t size, size_t align)
+{
+    if (a->next_size == 0) {
+        a->next_size = ARENA_MIN_BLOCK;
+    }
+
+    // Blocks grow geometrically, so the number of blocks (and the cost of releasing them) stays
+    // logarithmic in the total size. Oversized requests get a block of their own.
+    size_t block_size = a->next_size;
+    if (size + align + sizeof(arena_block) > block_size) {
+        block_size = size + align + sizeof(arena_block);
+    } else if (a->next_size < ARENA_MAX_BLOCK) {
+        a->next_size *= 2;
+    }
+
+    auto *b = (arena_block *) malloc(block_size);
+    if (!b) {
+        fprintf(stderr, "arena: out of memory allocating %zu bytes\n", block_size);
+        abort();
+    }
+    b->next = a->head;
+    a->head = b;
+    a->curr = (char *) (b + 1);
+    a->end = (char *) b + block_size;
+
+    return arena_alloc(a, size, align);
+}
+
+} // owl
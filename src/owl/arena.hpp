@@ -0,0 +1,89 @@
+#ifndef OWL_ARENA_HPP
+#define OWL_ARENA_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Bump pointer arena. Everything allocated from the arena is released at once when the arena is
+ * destroyed, destructors of the allocated objects are never called.
+ */
+
+namespace owl {
+
+struct arena_block;
+
+struct arena {
+    arena_block *head = nullptr;
+    char *curr = nullptr;
+    char *end = nullptr;
+
+    // Size of the next block to allocate, grows up to a limit
+    size_t next_size = 0;
+
+    arena() = default;
+    arena(const arena &) = delete;
+    arena &operator=(const arena &) = delete;
+    ~arena();
+};
+
+void *arena_alloc_slow(arena *a, size_t size, size_t align);
+
+inline void *arena_alloc(arena *a, size_t size, size_t align)
+{
+    uintptr_t p = ((uintptr_t) a->curr + align - 1) & ~(uintptr_t)(align - 1);
+    if (a->curr && p + size <= (uintptr_t) a->end) {
+        a->curr = (char *) (p + size);
+        return (void *) p;
+    }
+    return arena_alloc_slow(a, size, align);
+}
+
+template <class T, class... Args>
+T *arena_new(arena *a, Args &&... args)
+{
+    return new (arena_alloc(a, sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+}
+
+/**
+ * STL allocator on top of the arena. Deallocation is a no-op.
+ */
+template <class T>
+struct arena_allocator {
+    typedef T value_type;
+
+    arena *a = nullptr;
+
+    explicit arena_allocator(arena *a): a{a} {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U> &other): a{other.a}
+    {
+    }
+
+    T *allocate(size_t n) { return (T *) arena_alloc(a, n * sizeof(T), alignof(T)); }
+    void deallocate(T *p, size_t n) {}
+};
+
+template <class T, class U>
+bool operator==(const arena_allocator<T> &l, const arena_allocator<U> &r)
+{
+    return l.a == r.a;
+}
+
+template <class T, class U>
+bool operator!=(const arena_allocator<T> &l, const arena_allocator<U> &r)
+{
+    return l.a != r.a;
+}
+
+template <class T>
+using arena_vector = std::vector<T, arena_allocator<T>>;
+
+} // owl
+
+#endif
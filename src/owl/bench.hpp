@@ -0,0 +1,184 @@
+#ifndef OWL_BENCH_HPP
+#define OWL_BENCH_HPP
+
+#include "owl/context.hpp"
+#include "owl/source.hpp"
+#include "owl/thread_pool.hpp"
+#include "owl/visitor.hpp"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+#include <string_view>
+
+/**
+ * Benchmark harness. Every benchmark is a binary of its own, it runs a single compiler stage on
+ * the input files and prints a JSON line per file, so results can be collected and compared
+ * between builds.
+ */
+
+namespace owl {
+
+struct bench_result {
+    const char *bench = nullptr;
+    const char *input = nullptr;
+    size_t bytes = 0;
+    size_t iterations = 0;
+    double seconds = 0;
+    // Items processed by one iteration, e.g. tokens or model nodes
+    size_t items = 0;
+    const char *unit = "items";
+    int threads = 1;
+};
+
+// Benchmark of one input, fills in iterations, time and items. Returns false on failure.
+typedef bool (*bench_fn)(context *ctx, std::string_view code, bench_result *r);
+
+struct bench_options {
+    double min_seconds = 1.0;
+    size_t min_iterations = 3;
+    int n_threads = 1; // Stages that run in parallel use a pool of this size
+};
+
+inline double bench_now()
+{
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(t).count();
+}
+
+// Run fn until both minimum time and iterations are reached. fn returns number of items
+// processed, or 0 on failure.
+template <typename Fn>
+bool bench_loop(const bench_options *opts, bench_result *r, Fn fn)
+{
+    double start = bench_now();
+    double now = start;
+    size_t n = 0;
+    while (n < opts->min_iterations || now - start < opts->min_seconds) {
+        size_t items = fn();
+        if (!items) {
+            return false;
+        }
+        r->items = items;
+        n++;
+        now = bench_now();
+    }
+
+    r->iterations = n;
+    r->seconds = now - start;
+    return true;
+}
+
+inline void print_bench(FILE *f, const bench_result *r)
+{
+    double per_iter = r->seconds / r->iterations;
+    fprintf(f,
+            "{\"bench\": \"%s\", \"input\": \"%s\", \"bytes\": %zu, \"iterations\": %zu, "
+            "\"seconds\": %.6f, \"mb_per_s\": %.2f, \"items\": %zu, \"unit\": \"%s\", "
+            "\"items_per_s\": %.0f, \"threads\": %d}\n",
+            r->bench,
+            r->input,
+            r->bytes,
+            r->iterations,
+            r->seconds,
+            r->bytes / per_iter / (1 << 20),
+            r->items,
+            r->unit,
+            r->items / per_iter,
+            r->threads);
+    fflush(f);
+}
+
+struct count_pass: static_visitor<count_pass> {
+    size_t count = 0;
+
+    explicit count_pass(context *ctx): static_visitor(ctx) {}
+
+    template <typename T>
+    mod_node *visit_default(T *e)
+    {
+        count++;
+        visit_children(this, e);
+        return nullptr;
+    }
+};
+
+// Number of model nodes reachable by the visitor
+inline size_t count_nodes(context *ctx, mod_node *node)
+{
+    count_pass p(ctx);
+    visit(&p, node);
+    return p.count;
+}
+
+// Set from the command line by bench_main
+inline bench_options bench_opts;
+
+inline int bench_main(int argc, char **argv, const char *name, bench_fn fn)
+{
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "ht:n:j:")) != -1) {
+        switch (opt) {
+        case 't':
+            bench_opts.min_seconds = atof(optarg);
+            break;
+        case 'n':
+            bench_opts.min_iterations = strtoul(optarg, nullptr, 10);
+            break;
+        case 'j':
+            bench_opts.n_threads = atoi(optarg);
+            break;
+        default:
+            printf("Usage: %s [-t MIN_SECONDS] [-n MIN_ITERATIONS] [-j THREADS] FILE...\n",
+                    argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (bench_opts.min_iterations == 0) {
+        bench_opts.min_iterations = 1;
+    }
+    if (bench_opts.n_threads <= 0) {
+        bench_opts.n_threads = 1;
+    }
+
+    std::unique_ptr<thread_pool> pool;
+    if (bench_opts.n_threads > 1) {
+        pool = std::make_unique<thread_pool>(bench_opts.n_threads);
+    }
+
+    int rc = 0;
+    for (int i = optind; i < argc; i++) {
+        // Stage output is not part of the measurement
+        context ctx;
+        ctx.f_debug = nullptr;
+        ctx.file_name = argv[i];
+        ctx.pool = pool.get();
+
+        source_buffer source;
+        if (!load_source(&ctx, argv[i], &source)) {
+            rc = 1;
+            continue;
+        }
+
+        bench_result r;
+        r.bench = name;
+        r.input = argv[i];
+        r.bytes = source.view().size();
+        r.threads = bench_opts.n_threads;
+        if (!fn(&ctx, source.view(), &r)) {
+            fprintf(stderr, "%s: benchmark failed on '%s'\n", name, argv[i]);
+            rc = 1;
+            continue;
+        }
+        print_bench(stdout, &r);
+    }
+
+    return rc;
+}
+
+} // owl
+
+#endif
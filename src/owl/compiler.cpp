@@ -1,99 +1,268 @@
 #include "owl/compiler.hpp"
 
+#include "owl/arena.hpp"
 #include "owl/deduce_types.hpp"
+#include "owl/emit_c.hpp"
+#include "owl/flat_model.hpp"
+#include "owl/model_cache.hpp"
 #include "owl/parser.hpp"
+#include "owl/pass_manager.hpp"
+#include "owl/reparse.hpp"
+#include "owl/result_cache.hpp"
+#include "owl/source.hpp"
+#include "owl/symbols.hpp"
+#include "owl/trace.hpp"
+#include "owl/types.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
 
 namespace owl {
 
-// Check if we have a simple ASCII charset.
-static bool check_charset(context *ctx, std::string_view code)
+static void replay_output(context *ctx, const cached_result *r)
+{
+    if (ctx->f_debug) {
+        fwrite(r->debug_output.data(), 1, r->debug_output.size(), ctx->f_debug);
+    }
+    fwrite(r->error_output.data(), 1, r->error_output.size(), ctx->f_error);
+    ctx->n_errors += r->n_errors;
+}
+
+// Output of an unchanged file is replayed from the result cache, in memory or on disk. Otherwise
+// output is captured while the file is compiled, then printed and saved.
+static bool compile_cached(context *ctx, std::string_view code)
 {
-    int lnum = 1;
-    size_t line_first = 0;
-    for (size_t i = 0; i < code.size(); i++) {
-        bool valid = true;
-        char c = code[i];
-        switch (c) {
-        case '\n':
-            lnum++;
-            line_first = i + 1;
-            break;
-
-        case '\f':
-        case '\r':
-        case '\t':
-        case '\v':
-            break;
-
-        default:
-            valid = c >= ' ' && c <= 127;
-            break;
+    result_key key;
+    cached_result r;
+    {
+        trace_scope ts(ctx, "read_result_cache");
+        if (!make_result_key(ctx, code, &key)) {
+            return compile_string(ctx, code);
         }
-        if (!valid) {
-            compiler_error_at(ctx,
-                    lnum,
-                    i - line_first + 1,
-                    "(charset check) invalid character: '%c' ord=%d",
-                    c,
-                    (int) c);
-            return false;
+        if (ctx->results && find_result(ctx->results, &key, &r)) {
+            replay_output(ctx, &r);
+            return r.result;
+        }
+        if (!ctx->result_cache_dir.empty() && read_result_cache(ctx, &key, &r)) {
+            if (ctx->results) {
+                store_result(ctx->results, &key, &r);
+            }
+            replay_output(ctx, &r);
+            return r.result;
         }
     }
-    return true;
+
+    char *debug_buf = nullptr;
+    size_t debug_size = 0;
+    char *error_buf = nullptr;
+    size_t error_size = 0;
+    FILE *f_debug = ctx->f_debug ? open_memstream(&debug_buf, &debug_size) : nullptr;
+    FILE *f_error = open_memstream(&error_buf, &error_size);
+    if ((ctx->f_debug && !f_debug) || !f_error) {
+        if (f_debug) {
+            fclose(f_debug);
+            free(debug_buf);
+        }
+        if (f_error) {
+            fclose(f_error);
+            free(error_buf);
+        }
+        return compile_string(ctx, code);
+    }
+
+    context capture_ctx = *ctx;
+    capture_ctx.f_debug = f_debug;
+    capture_ctx.f_error = f_error;
+    capture_ctx.n_errors = 0;
+    r.result = compile_string(&capture_ctx, code);
+    r.n_errors = capture_ctx.n_errors;
+
+    if (f_debug) {
+        fclose(f_debug);
+        r.debug_output.assign(debug_buf, debug_size);
+        free(debug_buf);
+    }
+    fclose(f_error);
+    r.error_output.assign(error_buf, error_size);
+    free(error_buf);
+
+    replay_output(ctx, &r);
+    if (ctx->results) {
+        store_result(ctx->results, &key, &r);
+    }
+    if (!ctx->result_cache_dir.empty()) {
+        trace_scope ts(ctx, "write_result_cache");
+        write_result_cache(ctx, &key, &r);
+    }
+    return r.result;
 }
 
-static std::string read_file(context *ctx, const char *file_name)
+bool compile_file(context *ctx, const char *file_name)
 {
-    auto *f = fopen(file_name, "rt");
-    if (!f) {
-        compiler_error(ctx, "failed to open file '%s'\n", file_name);
-        return std::string();
+    ctx->file_name = std::string(file_name);
+    if (ctx->trace) {
+        ctx->trace_file = add_trace_file(ctx->trace, file_name);
     }
 
-    fseek(f, 0L, SEEK_END);
-    long size = ftell(f);
-    fseek(f, 0L, SEEK_SET);
+    bool result = false;
+    {
+        trace_scope ts(ctx, "compile");
 
-    auto buf = std::string(size, ' ');
-    size_t read_size = fread(buf.data(), 1, size, f);
-    if (read_size != size) {
-        compiler_error(ctx, "failed to read file '%s': %zu size %zu\n", file_name, read_size, size);
-        return std::string();
+        // Mapping must stay alive while tokens and model refer to the code
+        source_buffer source;
+        bool loaded = false;
+        {
+            trace_scope ts(ctx, "load_source");
+            loaded = load_source(ctx, file_name, &source);
+        }
+        // Cached results have no C code, files that emit it are always compiled
+        const bool cached = ctx->results || !ctx->result_cache_dir.empty();
+        if (loaded && cached && ctx->c_output_dir.empty()) {
+            result = compile_cached(ctx, source.view());
+        } else if (loaded) {
+            result = compile_string(ctx, source.view());
+        }
     }
 
-    return buf;
+    if (ctx->trace) {
+        trace_flush(ctx->trace);
+    }
+    return result;
 }
 
-bool compile_file(context *ctx, const char *file_name)
+// Nodes are built from the model in the mapping, its locations moved to the source on the way
+static mod_unit *read_cached_model(context *ctx,
+        std::string_view code,
+        source_entry *source,
+        model_mapping *map,
+        arena *node_arena)
 {
-    std::string code = read_file(ctx, file_name);
-    if (code.empty()) {
-        return false;
+    trace_scope ts(ctx, "read_model_cache");
+
+    flat_view m;
+    if (!map_model_cache(ctx, map) || !read_model_cache(ctx, map, code, source, &m)) {
+        return nullptr;
     }
+    return expand(&m, node_arena);
+}
 
-    ctx->file_name = std::string(file_name);
-    if (!check_charset(ctx, code)) {
-        return false;
+static void write_cached_model(context *ctx,
+        std::string_view code,
+        const source_entry *source,
+        const mod_unit *unit,
+        const std::vector<def_range> &defs)
+{
+    trace_scope ts(ctx, "write_model_cache");
+    flat_model m;
+    if (flatten(unit, &m)) {
+        write_model_cache(ctx, code, source, defs, &m);
+    }
+}
+
+// Changed code is parsed against the model cached for an earlier version of the file
+static mod_unit *reparse_cached_model(context *ctx,
+        std::string_view code,
+        source_entry *source,
+        const model_mapping *map,
+        arena *node_arena)
+{
+    mod_unit *unit = nullptr;
+    std::vector<def_range> defs;
+    {
+        trace_scope ts(ctx, "reparse");
+        previous_model prev;
+        if (!read_previous_model(ctx, map, &prev)) {
+            return nullptr;
+        }
+        unit = reparse(ctx, code, source, &prev, node_arena, &defs);
+    }
+
+    if (unit) {
+        write_cached_model(ctx, code, source, unit, defs);
+    }
+    return unit;
+}
+
+static mod_unit *parse_code(
+        context *ctx, std::string_view code, source_entry *source, arena *node_arena)
+{
+    // Lexer runs on demand as parser consumes tokens
+    token_stream tokens;
+    token_stream_init(&tokens, ctx, code, source);
+
+    const bool cached = !ctx->model_cache_dir.empty();
+    std::vector<def_range> defs;
+    mod_unit *unit = nullptr;
+    {
+        // Includes lexing, lexer is driven by the parser
+        trace_scope ts(ctx, "parse");
+        unit = parse(ctx, node_arena, &tokens, cached ? &defs : nullptr);
+    }
+    if (!unit || tokens.failed) {
+        return nullptr;
     }
 
-    return compile_string(ctx, code);
+    if (cached) {
+        write_cached_model(ctx, code, source, unit, defs);
+    }
+    return unit;
 }
 
 bool compile_string(context *ctx, std::string_view code)
 {
     bool result = false;
-    std::vector<token> tokens;
+    if (code.size() > MAX_SOURCE_SIZE) {
+        compiler_error(ctx, "source code is too large: %zu bytes", code.size());
+        return false;
+    }
+
+    // Locations in the model are valid while source is registered
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    if (!source) {
+        compiler_error(ctx, "source address space exhausted");
+        return false;
+    }
 
+    // Owns the whole model, released at once when compilation is done
+    arena node_arena;
+    auto symbols = std::make_unique<symbol_table>();
+    ctx->symbols = symbols.get();
+
+    // Cache file is mapped once for both ways of reading it, and unmapped after compilation
+    model_mapping cache_map;
     mod_unit *unit = nullptr;
-    if (tokenize(ctx, code, &tokens)) {
-        unit = parse(ctx, tokens.data(), tokens.size());
-        if (unit) {
-            result = deduce_types(ctx, unit);
+    if (!ctx->model_cache_dir.empty()) {
+        unit = read_cached_model(ctx, code, source, &cache_map, &node_arena);
+        if (!unit) {
+            unit = reparse_cached_model(ctx, code, source, &cache_map, &node_arena);
+        }
+        if (!unit && symbols->entries.size() > 1) {
+            // Full parse starts with no symbols of the previous model
+            symbols = std::make_unique<symbol_table>();
+            ctx->symbols = symbols.get();
         }
     }
+    if (!unit) {
+        unit = parse_code(ctx, code, source, &node_arena);
+    }
 
-    destroy_rec(unit);
+    if (unit) {
+        // Independent passes share a walk over the model
+        trace_scope ts(ctx, "passes");
+        type_table types(ctx->symbols);
+        ctx->types = &types;
+        result = run_passes<deduce_pass>(ctx, unit);
+        if (result && !ctx->c_output_dir.empty()) {
+            trace_scope ts(ctx, "emit_c");
+            result = emit_c_file(ctx, unit);
+        }
+        ctx->types = nullptr;
+    }
 
+    remove_source(global_sources(), source);
+    ctx->symbols = nullptr;
     return result;
 }
 
@@ -0,0 +1,18 @@
+#include "owl/bench.hpp"
+#include "owl/compiler.hpp"
+
+using namespace owl;
+
+// Whole pipeline on code already in memory
+static bool bench_compiler(context *ctx, std::string_view code, bench_result *r)
+{
+    r->unit = "files";
+    return bench_loop(&bench_opts, r, [&]() -> size_t {
+        return compile_string(ctx, code) ? 1 : 0;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "compiler", &bench_compiler);
+}
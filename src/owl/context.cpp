@@ -1,11 +1,20 @@
 #include "owl/context.hpp"
 
+#include "owl/source.hpp"
+
 namespace owl {
 
-void compiler_error_va(context *ctx, int lnum, int cnum, const char *format, va_list va)
+void compiler_error_va(context *ctx, source_loc loc, const char *format, va_list va)
 {
-    if (!ctx->file_name.empty()) {
-        fprintf(ctx->f_error, "In %s", ctx->file_name.data());
+    std::string file_name = ctx->file_name;
+    int lnum = 0;
+    int cnum = 0;
+    if (loc != NO_LOC) {
+        decode_loc(global_sources(), loc, &file_name, &lnum, &cnum);
+    }
+
+    if (!file_name.empty()) {
+        fprintf(ctx->f_error, "In %s", file_name.data());
         if (lnum > 0) {
             fprintf(ctx->f_error, ":%d", lnum);
             if (cnum > 0) {
@@ -22,11 +31,11 @@ void compiler_error_va(context *ctx, int lnum, int cnum, const char *format, va_
     ctx->n_errors++;
 }
 
-void compiler_error_at(context *ctx, int lnum, int cnum, const char *format, ...)
+void compiler_error_at(context *ctx, source_loc loc, const char *format, ...)
 {
     va_list va;
     va_start(va, format);
-    compiler_error_va(ctx, lnum, cnum, format, va);
+    compiler_error_va(ctx, loc, format, va);
     va_end(va);
 }
 
@@ -34,8 +43,18 @@ void compiler_error(context *ctx, const char *format, ...)
 {
     va_list va;
     va_start(va, format);
-    compiler_error_va(ctx, 0, 0, format, va);
+    compiler_error_va(ctx, NO_LOC, format, va);
     va_end(va);
 }
 
+uint64_t output_options(const context *ctx)
+{
+    uint64_t bits = 0;
+    bits |= ctx->f_debug ? 1 : 0;
+    bits |= ctx->debug_lexer ? 2 : 0;
+    // Models loaded from the cache print no parser debug output
+    bits |= ctx->model_cache_dir.empty() ? 0 : 4;
+    return bits;
+}
+
 } // owl
@@ -1,6 +1,8 @@
 #ifndef OWL_CONTEXT_HPP
 #define OWL_CONTEXT_HPP
 
+#include <stdarg.h>
+#include <stdint.h>
 #include <stdio.h>
 
 #include <string>
@@ -8,20 +10,47 @@
 
 namespace owl {
 
+struct result_store;
+struct symbol_table;
+struct thread_pool;
+struct tracer;
+struct type_table;
+
+// Location in the global source address space, see source_manager
+typedef uint32_t source_loc;
+
+constexpr source_loc NO_LOC = 0;
+
 struct context {
     FILE *f_error = stderr;
-    FILE *f_debug = stdout;
+    FILE *f_debug = stdout; // Debug output is off if null
 
     int n_errors = 0;
     std::string file_name;
 
+    // Symbols of the current compilation
+    symbol_table *symbols = nullptr;
+    // Types of the current compilation, filled by passes
+    type_table *types = nullptr;
+
     // Parameters
-    bool debug_lexer;
+    bool debug_lexer = false;
+    tracer *trace = nullptr; // Phase timers, if enabled
+    uint32_t trace_file = 0; // File of the compilation in the tracer
+    std::string model_cache_dir; // Parsed models are cached in the directory, if set
+    std::string result_cache_dir; // Compilation results are cached in the directory, if set
+    result_store *results = nullptr; // Compilation results are cached in memory, if set
+    thread_pool *pool = nullptr; // Passes walk function bodies in parallel, if set
+    std::string c_output_dir; // C code of every file is written to the directory, if set
+    bool layout_report = false; // Layout of emitted objects is printed to debug output
 };
 
-void compiler_error_va(context *ctx, int lnum, int cnum, const char *format, va_list va);
+// Bits of the parameters that change compilation output, every such parameter must be included
+uint64_t output_options(const context *ctx);
+
+void compiler_error_va(context *ctx, source_loc loc, const char *format, va_list va);
 void compiler_error(context *ctx, const char *format, ...);
-void compiler_error_at(context *ctx, int lnum, int cnum, const char *format, ...);
+void compiler_error_at(context *ctx, source_loc loc, const char *format, ...);
 
 } // owl
 
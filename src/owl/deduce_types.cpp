@@ -1,104 +1,87 @@
 #include "owl/deduce_types.hpp"
 
-#include "owl/model.hpp"
-#include "owl/visitor.hpp"
+#include "owl/symbols.hpp"
 
-#include <iostream>
+#include <algorithm>
+#include <string_view>
 
 namespace owl {
 
-struct deduce_ctx {
-    //
-};
-
-static mod_node *visit_function(const visitor *v, deduce_ctx *dt_ctx, mod_function *e)
+void deduce_print_visit(deduce_pass *p, const char *entity)
 {
-    std::cout << "visit function " << e->name << "\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    fprintf(p->root_ctx->f_debug, "visit %s\n", entity);
 }
 
-static mod_node *visit_variable(const visitor *v, deduce_ctx *dt_ctx, mod_variable *e)
+void deduce_print_name(deduce_pass *p, const char *entity, symbol_id name)
 {
-    std::cout << "visit variable " << e->name << "\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    auto text = symbol_name(p->root_ctx->symbols, name);
+    fprintf(p->root_ctx->f_debug, "visit %s %.*s\n", entity, (int) text.size(), text.data());
 }
 
-static mod_node *visit_object(const visitor *v, deduce_ctx *dt_ctx, mod_object *e)
+void deduce_error(deduce_pass *p, source_loc loc, const char *format, symbol_id name)
 {
-    std::cout << "visit object " << e->name << "\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    auto text = symbol_name(p->root_ctx->symbols, name);
+    compiler_error_at(p->root_ctx, loc, format, (int) text.size(), text.data());
+    p->failed = true;
 }
 
-static mod_node *visit_struct(const visitor *v, deduce_ctx *dt_ctx, mod_struct *e)
+// Literal must fit into long, the widest integer type
+void deduce_check_literal(deduce_pass *p, mod_expr_value *e)
 {
-    std::cout << "visit struct " << e->name << "\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    static const std::string_view LONG_MAX_DIGITS = "9223372036854775807";
+
+    std::string_view digits = symbol_name(p->root_ctx->symbols, e->value);
+    digits.remove_prefix(std::min(digits.find_first_not_of('0'), digits.size()));
+    if (digits.size() > LONG_MAX_DIGITS.size()
+            || (digits.size() == LONG_MAX_DIGITS.size() && digits > LONG_MAX_DIGITS)) {
+        deduce_error(p, e->loc, "number literal '%.*s' is too large", e->value);
+    }
 }
 
-static mod_node *visit_type(const visitor *v, deduce_ctx *dt_ctx, mod_type *e)
+static void bind_def(
+        deduce_pass *p, scope_table *t, const char *format, symbol_id name, mod_node *e)
 {
-    std::cout << "visit type " << e->name << "\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    if (bind_name(t, name, e)) {
+        deduce_error(p, e->loc, format, name);
+    }
 }
 
-static mod_node *visit_body(const visitor *v, deduce_ctx *dt_ctx, mod_body *e)
+static void define_type(deduce_pass *p, symbol_id name, mod_node *def)
 {
-    std::cout << "visit body\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    type_definition *type = find_type(p->root_ctx->types, name);
+    if (!type) {
+        add_type(p->root_ctx->types, name, def);
+    } else if (type->def != def) {
+        deduce_error(p, def->loc, "type '%.*s' is already defined", name);
+    }
 }
 
-static mod_node *visit_stmt_return(const visitor *v, deduce_ctx *dt_ctx, mod_stmt_return *e)
+void deduce_bind_fields(deduce_pass *p, mod_object *e)
 {
-    std::cout << "visit stmt return\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    for (mod_variable *field : e->fields) {
+        bind_def(p, &p->values, "field '%.*s' is already defined", field->name, field);
+    }
 }
 
-static mod_node *visit_expr_apply(const visitor *v, deduce_ctx *dt_ctx, mod_expr_apply *e)
+void deduce_bind_defs(deduce_pass *p, mod_unit *e)
 {
-    std::cout << "visit expr apply\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
+    for (mod_function *f : e->functions) {
+        bind_def(p, &p->values, "'%.*s' is already defined", f->name, f);
+    }
+    for (mod_variable *v : e->variables) {
+        bind_def(p, &p->values, "'%.*s' is already defined", v->name, v);
+    }
+    for (mod_object *o : e->objects) {
+        define_type(p, o->name, o);
+    }
+    for (mod_struct *s : e->structs) {
+        define_type(p, s->name, s);
+    }
 }
 
-static mod_node *visit_expr_value(const visitor *v, deduce_ctx *dt_ctx, mod_expr_value *e)
+bool deduce_types(context *ctx, mod_unit *unit)
 {
-    std::cout << "visit expr value\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
-}
-
-static mod_node *visit_unit(const visitor *v, deduce_ctx *dt_ctx, mod_unit *e)
-{
-    std::cout << "visit unit\n";
-    visit_children(v, dt_ctx, e);
-    return nullptr;
-}
-
-bool deduce_types(context *ctx, mod_node *node)
-{
-    visitor v(ctx);
-    v.visit[MOD_FUNCTION] = (visit_fn) visit_function;
-    v.visit[MOD_VARIABLE] = (visit_fn) visit_variable;
-    v.visit[MOD_OBJECT] = (visit_fn) visit_object;
-    v.visit[MOD_STRUCT] = (visit_fn) visit_struct;
-    v.visit[MOD_TYPE] = (visit_fn) visit_type;
-    v.visit[MOD_BODY] = (visit_fn) visit_body;
-    v.visit[MOD_STMT_RETURN] = (visit_fn) visit_stmt_return;
-    v.visit[MOD_EXPR_APPLY] = (visit_fn) visit_expr_apply;
-    v.visit[MOD_EXPR_VALUE] = (visit_fn) visit_expr_value;
-    v.visit[MOD_UNIT] = (visit_fn) visit_unit;
-
-    deduce_ctx dt_ctx;
-
-    visit(&v, &dt_ctx, node);
-    return true;
+    return run_passes<deduce_pass>(ctx, unit);
 }
 
 } // owl
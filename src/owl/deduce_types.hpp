@@ -2,6 +2,10 @@
 #define OWL_DEDUCE_TYPES_HPP
 
 #include "owl/context.hpp"
+#include "owl/model.hpp"
+#include "owl/pass_manager.hpp"
+#include "owl/scopes.hpp"
+#include "owl/types.hpp"
 
 /**
  * Deduce entity types.
@@ -9,9 +13,160 @@
 
 namespace owl {
 
-struct mod_node;
+/**
+ * Resolves types of definitions and expressions, looks up object and struct definitions. Functions
+ * and variables share one namespace, objects and structs are added to the type table of the
+ * context. Global definitions are bound before the walk, so they may be used before they are
+ * defined; object fields and function bodies open nested scopes.
+ */
+struct deduce_pass: model_pass {
+    static constexpr const char *name = "deduce_types";
+    static constexpr uint32_t reads = mod_kind(MOD_OBJECT) | mod_kind(MOD_STRUCT);
+    static constexpr uint32_t writes = mod_kind(MOD_FUNCTION) | mod_kind(MOD_VARIABLE)
+            | mod_kind(MOD_TYPE) | mod_kind(MOD_EXPR_APPLY) | mod_kind(MOD_EXPR_VALUE);
+    static constexpr bool independent_bodies = true;
+
+    scope_table values;
+    bool failed = false;
+
+    explicit deduce_pass(context *ctx): model_pass(ctx) {}
+
+    // Bodies walked in parallel see the global scope of the walk
+    void begin_part(const deduce_pass &walk);
+    bool finish() { return !failed; }
+
+    void pre(mod_function *e);
+    void pre(mod_variable *e);
+    void pre(mod_object *e);
+    void post(mod_object *e);
+    void pre(mod_struct *e);
+    void pre(mod_type *e);
+    void pre(mod_body *e);
+    void post(mod_body *e);
+    void pre(mod_stmt_return *e);
+    void pre(mod_expr_apply *e);
+    void pre(mod_expr_value *e);
+    void pre(mod_unit *e);
+};
+
+// Debug output and errors, out of line
+void deduce_print_visit(deduce_pass *p, const char *entity);
+void deduce_print_name(deduce_pass *p, const char *entity, symbol_id name);
+void deduce_error(deduce_pass *p, source_loc loc, const char *format, symbol_id name);
+void deduce_check_literal(deduce_pass *p, mod_expr_value *e);
+void deduce_bind_defs(deduce_pass *p, mod_unit *e);
+void deduce_bind_fields(deduce_pass *p, mod_object *e);
+
+// Number literals of fewer digits fit into long
+constexpr size_t MAX_SAFE_LITERAL_DIGITS = 18;
+
+// Handlers are inline, so the walk of run_passes() is a single function wherever it is run
+
+inline void deduce_pass::begin_part(const deduce_pass &walk)
+{
+    values.parent = &walk.values;
+}
+
+inline void deduce_pass::pre(mod_function *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_name(this, "function", e->name);
+    }
+}
+
+inline void deduce_pass::pre(mod_variable *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_name(this, "variable", e->name);
+    }
+}
+
+inline void deduce_pass::pre(mod_object *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_name(this, "object", e->name);
+    }
+    push_scope(&values);
+    deduce_bind_fields(this, e);
+}
+
+inline void deduce_pass::post(mod_object *e)
+{
+    pop_scope(&values);
+}
+
+inline void deduce_pass::pre(mod_struct *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_name(this, "struct", e->name);
+    }
+}
+
+inline void deduce_pass::pre(mod_type *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_name(this, "type", e->name);
+    }
+
+    e->type_def = find_type(root_ctx->types, e->name);
+    if (!e->type_def) {
+        deduce_error(this, e->loc, "unknown type '%.*s'", e->name);
+    }
+}
+
+inline void deduce_pass::pre(mod_body *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_visit(this, "body");
+    }
+    push_scope(&values);
+}
+
+inline void deduce_pass::post(mod_body *e)
+{
+    pop_scope(&values);
+}
+
+inline void deduce_pass::pre(mod_stmt_return *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_visit(this, "stmt return");
+    }
+}
+
+inline void deduce_pass::pre(mod_expr_apply *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_visit(this, "expr apply");
+    }
+
+    mod_node *def = lookup_name(&values, e->name);
+    if (!def || def->type != MOD_FUNCTION) {
+        deduce_error(this, e->loc, "'%.*s' is not a function", e->name);
+        return;
+    }
+    e->function = static_cast<mod_function *>(def);
+}
+
+inline void deduce_pass::pre(mod_expr_value *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_visit(this, "expr value");
+    }
+    if (symbol_name(root_ctx->symbols, e->value).size() > MAX_SAFE_LITERAL_DIGITS) {
+        deduce_check_literal(this, e);
+    }
+}
+
+inline void deduce_pass::pre(mod_unit *e)
+{
+    if (root_ctx->f_debug) {
+        deduce_print_visit(this, "unit");
+    }
+    deduce_bind_defs(this, e);
+}
 
-bool deduce_types(context *ctx, mod_node *node);
+bool deduce_types(context *ctx, mod_unit *unit);
 
 } // owl
 
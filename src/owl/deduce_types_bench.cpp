@@ -0,0 +1,43 @@
+#include "owl/arena.hpp"
+#include "owl/bench.hpp"
+#include "owl/deduce_types.hpp"
+#include "owl/lexer.hpp"
+#include "owl/parser.hpp"
+#include "owl/symbols.hpp"
+#include "owl/types.hpp"
+
+using namespace owl;
+
+// Model is built once, only the pass itself is measured
+static bool bench_deduce_types(context *ctx, std::string_view code, bench_result *r)
+{
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    arena node_arena;
+    symbol_table symbols;
+    ctx->symbols = &symbols;
+
+    token_stream tokens;
+    token_stream_init(&tokens, ctx, code, source);
+    mod_unit *unit = parse(ctx, &node_arena, &tokens);
+
+    bool result = false;
+    if (unit && !tokens.failed) {
+        type_table types(&symbols);
+        ctx->types = &types;
+        size_t n = count_nodes(ctx, unit);
+        r->unit = "nodes";
+        result = bench_loop(&bench_opts, r, [&]() -> size_t {
+            return deduce_types(ctx, unit) ? n : 0;
+        });
+    }
+
+    remove_source(global_sources(), source);
+    ctx->symbols = nullptr;
+    ctx->types = nullptr;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "deduce_types", &bench_deduce_types);
+}
@@ -0,0 +1,135 @@
+#include "owl/driver.hpp"
+
+#include "owl/compiler.hpp"
+#include "owl/emit_c.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace owl {
+
+static void run_job(compile_job *job, bool buffered)
+{
+    if (buffered) {
+        FILE *f_debug = open_memstream(&job->debug_buf, &job->debug_size);
+        FILE *f_error = open_memstream(&job->error_buf, &job->error_size);
+        if (f_debug && f_error) {
+            job->ctx.f_debug = f_debug;
+            job->ctx.f_error = f_error;
+        } else {
+            // Output is printed as it comes, out of order, flush gets empty buffers
+            if (f_debug) {
+                fclose(f_debug);
+            }
+            if (f_error) {
+                fclose(f_error);
+            }
+            free(job->debug_buf);
+            free(job->error_buf);
+            job->debug_buf = nullptr;
+            job->error_buf = nullptr;
+            job->debug_size = 0;
+            job->error_size = 0;
+            buffered = false;
+        }
+    }
+
+    if (job->c_output_taken_by) {
+        compiler_error(&job->ctx,
+                "C code of '%s' and '%s' would be written to the same file '%s'",
+                job->c_output_taken_by->file_name.c_str(),
+                job->file_name.c_str(),
+                c_output_path(job->ctx.c_output_dir, job->file_name).c_str());
+    } else {
+        job->result = compile_file(&job->ctx, job->file_name.c_str());
+    }
+    if (!job->result) {
+        fprintf(job->ctx.f_error, "Failed to compile '%s'\n", job->file_name.c_str());
+    }
+
+    if (buffered) {
+        fclose(job->ctx.f_debug);
+        fclose(job->ctx.f_error);
+    }
+}
+
+static void flush_job(compile_job *job, const flush_fn &flush)
+{
+    flush(job);
+    free(job->debug_buf);
+    free(job->error_buf);
+    job->debug_buf = nullptr;
+    job->error_buf = nullptr;
+}
+
+int compile_files(const context *options,
+        const std::vector<std::string> &files,
+        thread_pool *pool,
+        flush_fn flush)
+{
+    std::vector<std::unique_ptr<compile_job>> jobs;
+    for (const auto &file_name : files) {
+        auto job = std::make_unique<compile_job>();
+        job->file_name = file_name;
+        job->ctx = *options;
+        jobs.push_back(std::move(job));
+    }
+
+    // Files must not overwrite each other's C code
+    if (!options->c_output_dir.empty()) {
+        std::unordered_map<std::string, const compile_job *> outputs;
+        for (auto &job : jobs) {
+            auto [it, added] = outputs.emplace(
+                    c_output_path(options->c_output_dir, job->file_name), job.get());
+            if (!added) {
+                job->c_output_taken_by = it->second;
+            }
+        }
+    }
+
+    if (!pool) {
+        const bool buffered = bool(flush);
+        for (auto &job : jobs) {
+            run_job(job.get(), buffered);
+            if (buffered) {
+                flush_job(job.get(), flush);
+            }
+        }
+    } else {
+        std::mutex mutex;
+        std::condition_variable cv;
+
+        for (auto &job : jobs) {
+            auto *p = job.get();
+            thread_pool_submit(pool, [p, &mutex, &cv] {
+                run_job(p, true);
+                std::lock_guard<std::mutex> lock(mutex);
+                p->done = true;
+                cv.notify_all();
+            });
+        }
+
+        // Print output as soon as the next file in order is done
+        for (auto &job : jobs) {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&job] { return job->done; });
+            lock.unlock();
+            flush_job(job.get(), flush);
+        }
+    }
+
+    int n_errors = 0;
+    bool failed = false;
+    for (auto &job : jobs) {
+        n_errors += job->ctx.n_errors;
+        failed = failed || !job->result;
+    }
+    return n_errors > 0 || failed ? 1 : 0;
+}
+
+} // owl
@@ -0,0 +1,52 @@
+#ifndef OWL_DRIVER_HPP
+#define OWL_DRIVER_HPP
+
+#include "owl/context.hpp"
+#include "owl/thread_pool.hpp"
+
+#include <stddef.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Compiler driver. Compiles a list of files, every file with its own context copied from the
+ * options. Used by the command line and by the compile server.
+ */
+
+namespace owl {
+
+struct compile_job {
+    std::string file_name;
+    context ctx;
+    bool result = false;
+
+    // Output, if buffered
+    char *debug_buf = nullptr;
+    size_t debug_size = 0;
+    char *error_buf = nullptr;
+    size_t error_size = 0;
+
+    // Earlier file of the list whose C code goes to the same output path, the job is not compiled
+    const compile_job *c_output_taken_by = nullptr;
+
+    bool done = false;
+};
+
+// Receives buffered output of a job, buffers are freed by the driver afterwards
+typedef std::function<void(compile_job *job)> flush_fn;
+
+/**
+ * Without pool and flush, files are compiled in order and print straight to the streams of the
+ * options. Otherwise output of every file is buffered and handed to flush in the list order as
+ * soon as the file is done. Returns the exit code.
+ */
+int compile_files(const context *options,
+        const std::vector<std::string> &files,
+        thread_pool *pool,
+        flush_fn flush);
+
+} // owl
+
+#endif
@@ -0,0 +1,700 @@
+#include "owl/emit_c.hpp"
+
+#include "owl/symbols.hpp"
+#include "owl/types.hpp"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace owl {
+
+// Smallest buffer, short output is written at once anyway
+constexpr size_t MIN_WRITE_BLOCK = 4096;
+
+code_writer::code_writer(int fd, size_t size_hint): fd{fd}
+{
+    const size_t size = std::clamp(size_hint, MIN_WRITE_BLOCK, MAX_WRITE_BLOCK);
+    buf = (char *) malloc(size);
+    if (!buf) {
+        fprintf(stderr, "code_writer: out of memory allocating %zu bytes\n", size);
+        abort();
+    }
+    curr = buf;
+    end = buf + size;
+}
+
+code_writer::~code_writer()
+{
+    free(buf);
+}
+
+static void write_all(code_writer *w, const char *p, size_t n)
+{
+    while (n > 0 && !w->failed) {
+        ssize_t k = write(w->fd, p, n);
+        if (k < 0 && errno == EINTR) {
+            continue;
+        }
+        if (k <= 0) {
+            w->failed = true;
+            break;
+        }
+        p += k;
+        n -= k;
+    }
+}
+
+bool flush_writer(code_writer *w)
+{
+    write_all(w, w->buf, w->curr - w->buf);
+    w->curr = w->buf;
+    return !w->failed;
+}
+
+void write_text_slow(code_writer *w, std::string_view s)
+{
+    flush_writer(w);
+    if (s.size() >= (size_t) (w->end - w->buf)) {
+        write_all(w, s.data(), s.size());
+        return;
+    }
+    memcpy(w->curr, s.data(), s.size());
+    w->curr += s.size();
+}
+
+static const char PROLOGUE[] = "#include <stdbool.h>\n#include <stdint.h>\n#include <stdlib.h>\n";
+
+/**
+ * C type of a field or variable, with its size and alignment on the target.
+ */
+struct c_type {
+    // User type, or null
+    const type_definition *def = nullptr;
+    // Builtin type
+    std::string_view name;
+
+    uint32_t size = 0;
+    uint32_t align = 0;
+};
+
+// Owl builtin types, size is the alignment
+static const std::pair<const char *, c_type> BUILTIN_C_TYPES[] = {
+        {"bool", {nullptr, "bool", 1, 1}},
+        {"byte", {nullptr, "uint8_t", 1, 1}},
+        {"int", {nullptr, "int32_t", 4, 4}},
+        {"long", {nullptr, "int64_t", 8, 8}},
+        {"float", {nullptr, "float", 4, 4}},
+        {"double", {nullptr, "double", 8, 8}},
+};
+
+// Type of variables that have neither a type nor an initializer
+static const c_type DEFAULT_C_TYPE = {nullptr, "int32_t", 4, 4};
+static const c_type LONG_C_TYPE = {nullptr, "int64_t", 8, 8};
+// Return type of functions that return no value
+static const c_type VOID_C_TYPE = {nullptr, "void", 0, 0};
+
+// Layout of types is reported in lines of this size
+constexpr uint32_t CACHE_LINE = 64;
+
+// Owl names that cannot be used as C names as they are, separated by spaces
+static const char C_RESERVED[] =
+        "auto break case char const continue default do double else enum extern float for goto if "
+        "inline int long register restrict return short signed sizeof static struct switch "
+        "typedef union unsigned void volatile while _Bool _Complex _Imaginary _Alignas _Alignof "
+        "_Atomic _Generic _Noreturn _Static_assert _Thread_local bool true false NULL int8_t "
+        "int16_t int32_t int64_t uint8_t uint16_t uint32_t uint64_t size_t";
+
+struct emit_ctx {
+    context *ctx = nullptr;
+    code_writer *w = nullptr;
+
+    // Indexed by symbol id
+    std::vector<uint8_t> reserved;
+    // Indexed by type id, C type of a builtin type
+    std::vector<c_type> builtin_types;
+    // Return types of functions that declare none, as they are deduced
+    std::unordered_map<const mod_function *, c_type> return_types;
+};
+
+static void init_emit_ctx(emit_ctx *e, context *ctx, code_writer *w)
+{
+    e->ctx = ctx;
+    e->w = w;
+
+    // Names that are not interned are not used by the unit
+    e->reserved.assign(ctx->symbols->entries.size(), 0);
+    std::string_view names = C_RESERVED;
+    while (!names.empty()) {
+        size_t n = std::min(names.find(' '), names.size());
+        symbol_id id = find_symbol(ctx->symbols, names.substr(0, n));
+        if (id != NO_SYMBOL) {
+            e->reserved[id] = 1;
+        }
+        names.remove_prefix(std::min(n + 1, names.size()));
+    }
+
+    const type_table *types = ctx->types;
+    e->builtin_types.assign(types->types.size(), c_type());
+    for (const auto &[name, type] : BUILTIN_C_TYPES) {
+        const type_definition *t = find_type(types, find_symbol(ctx->symbols, name));
+        if (t) {
+            e->builtin_types[t->id] = type;
+        }
+    }
+}
+
+static void write_name(emit_ctx *e, symbol_id name)
+{
+    write_text(e->w, symbol_name(e->ctx->symbols, name));
+    if (e->reserved[name]) {
+        write_text(e->w, "_");
+    }
+}
+
+static c_type type_of(emit_ctx *e, const type_definition *t)
+{
+    if (t->is_builtin) {
+        return e->builtin_types[t->id];
+    }
+
+    c_type type;
+    type.def = t;
+    // Structs have a single char member
+    type.size = t->is_ref ? sizeof(void *) : 1;
+    type.align = type.size;
+    return type;
+}
+
+// Digits of a number literal without leading zeros, which would make it octal in C
+static std::string_view literal_digits(std::string_view text)
+{
+    size_t start = text.find_first_not_of('0');
+    return start == std::string_view::npos ? text.substr(text.size() - 1) : text.substr(start);
+}
+
+// Literals that do not fit into int64_t are rejected by deduce_types
+static c_type literal_type(std::string_view text)
+{
+    // Decimal literals longer than 9 digits may not fit into int32_t
+    return literal_digits(text).size() > 9 ? LONG_C_TYPE : DEFAULT_C_TYPE;
+}
+
+static c_type return_type(emit_ctx *e, const mod_function *f);
+
+static c_type expr_type(emit_ctx *e, const mod_expr *expr)
+{
+    if (expr->type == MOD_EXPR_VALUE) {
+        auto *value = static_cast<const mod_expr_value *>(expr);
+        return literal_type(symbol_name(e->ctx->symbols, value->value));
+    }
+
+    auto *apply = static_cast<const mod_expr_apply *>(expr);
+    return apply->function ? return_type(e, apply->function) : DEFAULT_C_TYPE;
+}
+
+// Function without a declared type returns the type of its first returned value, as variables
+// without one get the type of their initializer. Functions that return only each other's results
+// return the default type.
+static c_type return_type(emit_ctx *e, const mod_function *f)
+{
+    if (f->data_type && f->data_type->type_def) {
+        return type_of(e, f->data_type->type_def);
+    }
+
+    auto [it, added] = e->return_types.try_emplace(f, DEFAULT_C_TYPE);
+    if (!added) {
+        return it->second;
+    }
+
+    c_type type = VOID_C_TYPE;
+    for (const mod_node *stmt : f->body->statements) {
+        auto *ret = static_cast<const mod_stmt_return *>(stmt);
+        if (ret->expr) {
+            type = expr_type(e, ret->expr);
+            break;
+        }
+    }
+    // Map may have grown, the iterator is not valid
+    e->return_types[f] = type;
+    return type;
+}
+
+static c_type var_type(emit_ctx *e, const mod_variable *v)
+{
+    if (v->data_type && v->data_type->type_def) {
+        return type_of(e, v->data_type->type_def);
+    }
+
+    // Value of a function that returns none has no type either
+    c_type type = v->init_expr ? expr_type(e, v->init_expr) : DEFAULT_C_TYPE;
+    return type.size ? type : DEFAULT_C_TYPE;
+}
+
+// Type followed by a space, or '*' for reference types
+static void write_type(emit_ctx *e, const c_type &type)
+{
+    if (!type.def) {
+        write_text(e->w, type.name);
+        write_text(e->w, " ");
+        return;
+    }
+    write_name(e, type.def->name);
+    write_text(e->w, type.def->is_ref ? " *" : " ");
+}
+
+static void write_expr(emit_ctx *e, const mod_expr *expr)
+{
+    if (expr->type == MOD_EXPR_VALUE) {
+        auto *value = static_cast<const mod_expr_value *>(expr);
+        write_text(e->w, literal_digits(symbol_name(e->ctx->symbols, value->value)));
+        return;
+    }
+
+    assert(expr->type == MOD_EXPR_APPLY);
+    auto *apply = static_cast<const mod_expr_apply *>(expr);
+    write_name(e, apply->name);
+    write_text(e->w, "(");
+    for (size_t i = 0; i < apply->args.size(); i++) {
+        write_text(e->w, i > 0 ? ", " : "");
+        write_name(e, apply->args[i]->name);
+    }
+    write_text(e->w, ")");
+}
+
+static void write_forward(emit_ctx *e, symbol_id name)
+{
+    write_text(e->w, "typedef struct ");
+    write_name(e, name);
+    write_text(e->w, " ");
+    write_name(e, name);
+    write_text(e->w, ";\n");
+}
+
+struct field_slot {
+    const mod_variable *field = nullptr;
+    c_type type;
+};
+
+struct struct_layout {
+    uint32_t size = 0;
+    uint32_t align = 1;
+    uint32_t padding = 0;
+};
+
+// Layout C gives to the fields in the order they are listed
+static struct_layout layout_of(const std::vector<field_slot> &slots)
+{
+    struct_layout l;
+    uint32_t data_size = 0;
+    for (const field_slot &s : slots) {
+        l.size = (l.size + s.type.align - 1) / s.type.align * s.type.align + s.type.size;
+        l.align = std::max(l.align, s.type.align);
+        data_size += s.type.size;
+    }
+    // Empty struct has a char member
+    l.size = std::max<uint32_t>(l.size, 1);
+    l.size = (l.size + l.align - 1) / l.align * l.align;
+    l.padding = l.size - std::max<uint32_t>(data_size, 1);
+    return l;
+}
+
+static void print_layout(emit_ctx *e,
+        const mod_object *o,
+        const struct_layout *l,
+        const struct_layout *declared)
+{
+    FILE *f = e->ctx->f_debug;
+    auto name = symbol_name(e->ctx->symbols, o->name);
+    fprintf(f,
+            "layout %.*s: size %u, padding %u, cache lines %u",
+            (int) name.size(),
+            name.data(),
+            l->size,
+            l->padding,
+            (l->size + CACHE_LINE - 1) / CACHE_LINE);
+    if (o->c_layout) {
+        fprintf(f, " (extern, in declaration order)\n");
+    } else {
+        fprintf(f,
+                " (declaration order: size %u, padding %u)\n",
+                declared->size,
+                declared->padding);
+    }
+}
+
+// Fields of "extern" objects stay in declaration order. Other fields are sorted by alignment, the
+// largest first, which leaves padding only at the end since sizes are multiples of alignment.
+static void write_fields(emit_ctx *e, const mod_object *o)
+{
+    std::vector<field_slot> slots;
+    slots.reserve(o->fields.size());
+    for (const mod_variable *f : o->fields) {
+        slots.push_back({f, var_type(e, f)});
+    }
+
+    const struct_layout declared = layout_of(slots);
+    if (!o->c_layout) {
+        std::stable_sort(slots.begin(), slots.end(), [](const field_slot &a, const field_slot &b) {
+            return a.type.align > b.type.align;
+        });
+    }
+    if (e->ctx->layout_report && e->ctx->f_debug) {
+        const struct_layout l = layout_of(slots);
+        print_layout(e, o, &l, &declared);
+    }
+
+    for (const field_slot &s : slots) {
+        write_text(e->w, "    ");
+        write_type(e, s.type);
+        write_name(e, s.field->name);
+        write_text(e->w, ";\n");
+    }
+}
+
+static void write_object(emit_ctx *e, const mod_object *o)
+{
+    write_text(e->w, "\nstruct ");
+    write_name(e, o->name);
+    write_text(e->w, " {\n");
+    write_fields(e, o);
+    // C structs must have a member
+    if (o->fields.empty()) {
+        write_text(e->w, "    char owl_unused;\n");
+    }
+    write_text(e->w, "};\n");
+
+    // Field initializers run when an object is created
+    write_text(e->w, "\nstatic inline void owl_init_");
+    write_text(e->w, symbol_name(e->ctx->symbols, o->name));
+    write_text(e->w, "(");
+    write_name(e, o->name);
+    write_text(e->w, " *self)\n{\n");
+    bool has_init = false;
+    for (const mod_variable *f : o->fields) {
+        has_init = has_init || f->init_expr;
+    }
+    if (!has_init) {
+        write_text(e->w, "    (void) self;\n");
+    }
+    for (const mod_variable *f : o->fields) {
+        if (f->init_expr) {
+            write_text(e->w, "    self->");
+            write_name(e, f->name);
+            write_text(e->w, " = ");
+            write_expr(e, f->init_expr);
+            write_text(e->w, ";\n");
+        }
+    }
+    write_text(e->w, "}\n");
+}
+
+static void write_array_name(emit_ctx *e, const mod_object *o)
+{
+    write_text(e->w, "owl_array_");
+    write_text(e->w, symbol_name(e->ctx->symbols, o->name));
+}
+
+// Array of a "soa" object is a struct of arrays, one per field, so a loop over one field reads
+// contiguous memory. Element i of the array is the field values at index i.
+static void write_soa_array(emit_ctx *e, const mod_object *o)
+{
+    write_text(e->w, "\ntypedef struct ");
+    write_array_name(e, o);
+    write_text(e->w, " {\n");
+    for (const mod_variable *f : o->fields) {
+        write_text(e->w, "    ");
+        write_type(e, var_type(e, f));
+        write_text(e->w, "*");
+        write_name(e, f->name);
+        write_text(e->w, ";\n");
+    }
+    write_text(e->w, "    size_t size;\n    size_t capacity;\n} ");
+    write_array_name(e, o);
+    write_text(e->w, ";\n");
+
+    // Field arrays grow one by one, capacity is updated once all have grown
+    write_text(e->w, "\nstatic inline bool ");
+    write_array_name(e, o);
+    write_text(e->w, "_reserve(");
+    write_array_name(e, o);
+    write_text(e->w, " *a, size_t capacity)\n{\n    if (capacity <= a->capacity) {\n");
+    write_text(e->w, "        return true;\n    }\n");
+    if (!o->fields.empty()) {
+        write_text(e->w, "    void *p = NULL;\n");
+    }
+    for (const mod_variable *f : o->fields) {
+        write_text(e->w, "    if (!(p = realloc(a->");
+        write_name(e, f->name);
+        write_text(e->w, ", capacity * sizeof(*a->");
+        write_name(e, f->name);
+        write_text(e->w, ")))) {\n        return false;\n    }\n    a->");
+        write_name(e, f->name);
+        write_text(e->w, " = p;\n");
+    }
+    write_text(e->w, "    a->capacity = capacity;\n    return true;\n}\n");
+
+    write_text(e->w, "\nstatic inline bool ");
+    write_array_name(e, o);
+    write_text(e->w, "_push(");
+    write_array_name(e, o);
+    write_text(e->w, " *a, const ");
+    write_name(e, o->name);
+    write_text(e->w, " *value)\n{\n    if (a->size == a->capacity\n            && !");
+    write_array_name(e, o);
+    write_text(e->w, "_reserve(a, a->capacity ? 2 * a->capacity : 16)) {\n");
+    write_text(e->w, "        return false;\n    }\n");
+    if (o->fields.empty()) {
+        write_text(e->w, "    (void) value;\n");
+    }
+    for (const mod_variable *f : o->fields) {
+        write_text(e->w, "    a->");
+        write_name(e, f->name);
+        write_text(e->w, "[a->size] = value->");
+        write_name(e, f->name);
+        write_text(e->w, ";\n");
+    }
+    write_text(e->w, "    a->size++;\n    return true;\n}\n");
+
+    write_text(e->w, "\nstatic inline void ");
+    write_array_name(e, o);
+    write_text(e->w, "_free(");
+    write_array_name(e, o);
+    write_text(e->w, " *a)\n{\n");
+    for (const mod_variable *f : o->fields) {
+        write_text(e->w, "    free(a->");
+        write_name(e, f->name);
+        write_text(e->w, ");\n");
+    }
+    write_text(e->w, "    *a = (");
+    write_array_name(e, o);
+    write_text(e->w, ") {0};\n}\n");
+}
+
+static void write_struct(emit_ctx *e, const mod_struct *s)
+{
+    write_text(e->w, "\nstruct ");
+    write_name(e, s->name);
+    write_text(e->w, " {\n    char owl_unused;\n};\n");
+}
+
+static void write_global(emit_ctx *e, const mod_variable *v)
+{
+    write_type(e, var_type(e, v));
+    write_name(e, v->name);
+    if (v->init_expr) {
+        write_text(e->w, " = ");
+        write_expr(e, v->init_expr);
+    }
+    write_text(e->w, ";\n");
+}
+
+static void write_signature(emit_ctx *e, const mod_function *f)
+{
+    write_type(e, return_type(e, f));
+    write_name(e, f->name);
+    write_text(e->w, "(void)");
+}
+
+static void write_function(emit_ctx *e, const mod_function *f)
+{
+    write_text(e->w, "\n");
+    write_signature(e, f);
+    write_text(e->w, "\n{\n");
+    for (const mod_node *stmt : f->body->statements) {
+        assert(stmt->type == MOD_STMT_RETURN);
+        auto *ret = static_cast<const mod_stmt_return *>(stmt);
+        write_text(e->w, "    return");
+        if (ret->expr) {
+            write_text(e->w, " ");
+            write_expr(e, ret->expr);
+        }
+        write_text(e->w, ";\n");
+    }
+    write_text(e->w, "}\n");
+}
+
+// Size of a name and of the text around it
+constexpr size_t NAME_OVERHEAD = 16;
+// Declaration with its punctuation, types and keywords
+constexpr size_t DECL_OVERHEAD = 64;
+
+static size_t name_size(context *ctx, symbol_id name)
+{
+    return symbol_name(ctx->symbols, name).size() + NAME_OVERHEAD;
+}
+
+static size_t expr_size(context *ctx, const mod_expr *expr)
+{
+    if (!expr) {
+        return 0;
+    }
+    if (expr->type == MOD_EXPR_VALUE) {
+        return name_size(ctx, static_cast<const mod_expr_value *>(expr)->value);
+    }
+
+    auto *apply = static_cast<const mod_expr_apply *>(expr);
+    size_t size = name_size(ctx, apply->name);
+    for (const mod_variable *arg : apply->args) {
+        size += name_size(ctx, arg->name);
+    }
+    return size;
+}
+
+static size_t var_size(context *ctx, const mod_variable *v)
+{
+    return DECL_OVERHEAD + name_size(ctx, v->name) + expr_size(ctx, v->init_expr);
+}
+
+size_t estimate_c_size(context *ctx, const mod_unit *unit)
+{
+    size_t size = sizeof(PROLOGUE);
+    for (const mod_object *o : unit->objects) {
+        // Forward declaration, struct and initializer
+        size += 3 * DECL_OVERHEAD + 5 * name_size(ctx, o->name);
+        for (const mod_variable *f : o->fields) {
+            // Declared in the struct, assigned in the initializer
+            size += 2 * var_size(ctx, f);
+        }
+        if (o->soa) {
+            // Array struct and its functions, fields are named in each
+            size += 4 * DECL_OVERHEAD + 12 * name_size(ctx, o->name);
+            for (const mod_variable *f : o->fields) {
+                size += 8 * name_size(ctx, f->name) + 2 * DECL_OVERHEAD;
+            }
+        }
+    }
+    for (const mod_struct *s : unit->structs) {
+        size += 2 * DECL_OVERHEAD + 3 * name_size(ctx, s->name);
+    }
+    for (const mod_variable *v : unit->variables) {
+        size += var_size(ctx, v);
+    }
+    for (const mod_function *f : unit->functions) {
+        // Prototype and definition
+        size += 2 * (DECL_OVERHEAD + name_size(ctx, f->name));
+        for (const mod_node *stmt : f->body->statements) {
+            size += DECL_OVERHEAD;
+            if (stmt->type == MOD_STMT_RETURN) {
+                size += expr_size(ctx, static_cast<const mod_stmt_return *>(stmt)->expr);
+            }
+        }
+    }
+    return size;
+}
+
+bool emit_c(context *ctx, const mod_unit *unit, int fd)
+{
+    code_writer w(fd, estimate_c_size(ctx, unit));
+    emit_ctx e;
+    init_emit_ctx(&e, ctx, &w);
+
+    write_text(&w, PROLOGUE);
+
+    // Types refer to each other through pointers, they are all declared first
+    if (!unit->objects.empty() || !unit->structs.empty()) {
+        write_text(&w, "\n");
+    }
+    for (const mod_object *o : unit->objects) {
+        write_forward(&e, o->name);
+    }
+    for (const mod_struct *s : unit->structs) {
+        write_forward(&e, s->name);
+    }
+    for (const mod_struct *s : unit->structs) {
+        write_struct(&e, s);
+    }
+    for (const mod_object *o : unit->objects) {
+        write_object(&e, o);
+        if (o->soa) {
+            write_soa_array(&e, o);
+        }
+    }
+
+    if (!unit->variables.empty()) {
+        write_text(&w, "\n");
+    }
+    for (const mod_variable *v : unit->variables) {
+        write_global(&e, v);
+    }
+
+    // Functions may be called before they are defined
+    if (!unit->functions.empty()) {
+        write_text(&w, "\n");
+    }
+    for (const mod_function *f : unit->functions) {
+        write_signature(&e, f);
+        write_text(&w, ";\n");
+    }
+    for (const mod_function *f : unit->functions) {
+        write_function(&e, f);
+    }
+
+    return flush_writer(&w);
+}
+
+std::string c_output_path(const std::string &dir, const std::string &file_name)
+{
+    if (file_name == "-") {
+        return dir + "/stdin.c";
+    }
+
+    std::string path = dir;
+    std::string_view rest = file_name;
+    while (!rest.empty()) {
+        const size_t n = std::min(rest.find('/'), rest.size());
+        std::string_view part = rest.substr(0, n);
+        rest.remove_prefix(std::min(n + 1, rest.size()));
+        if (part.empty() || part == ".") {
+            continue;
+        }
+        path += "/";
+        path += part == ".." ? "__" : part;
+    }
+
+    if (path.size() > dir.size() + 4 && path.compare(path.size() - 4, 4, ".owl") == 0) {
+        path.resize(path.size() - 4);
+    }
+    return path + ".c";
+}
+
+// Directories of the path below the output directory are created, the output directory must exist
+static void make_dirs(const std::string &dir, const std::string &path)
+{
+    for (size_t i = path.find('/', dir.size() + 1); i != std::string::npos;
+            i = path.find('/', i + 1)) {
+        mkdir(path.substr(0, i).c_str(), 0755);
+    }
+}
+
+bool emit_c_file(context *ctx, const mod_unit *unit)
+{
+    std::string path = c_output_path(ctx->c_output_dir, ctx->file_name);
+    make_dirs(ctx->c_output_dir, path);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        compiler_error(ctx, "cannot create '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    bool ok = emit_c(ctx, unit, fd);
+    int error = errno;
+    if (close(fd) != 0 && ok) {
+        ok = false;
+        error = errno;
+    }
+    if (!ok) {
+        compiler_error(ctx, "cannot write '%s': %s", path.c_str(), strerror(error));
+    }
+    return ok;
+}
+
+} // owl
@@ -0,0 +1,72 @@
+#ifndef OWL_EMIT_C_HPP
+#define OWL_EMIT_C_HPP
+
+#include "owl/context.hpp"
+#include "owl/model.hpp"
+
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <string_view>
+
+/**
+ * C backend. Lowers a unit with resolved types to a C translation unit: objects and structs become
+ * C structs (objects are used through pointers, they live on the heap), globals and functions keep
+ * their names. Names that are C keywords get a '_' appended, helpers have an "owl_" prefix.
+ *
+ * Code is appended to a buffer sized by an estimate of the whole output, so emitting is mostly
+ * memcpy; the buffer is written out with one write call whenever it is full and at the end.
+ */
+
+namespace owl {
+
+// Largest buffer, longer output is written in blocks of this size
+constexpr size_t MAX_WRITE_BLOCK = 4 << 20;
+
+struct code_writer {
+    int fd = -1;
+    char *buf = nullptr;
+    char *curr = nullptr;
+    char *end = nullptr;
+    // Write error, errno of the failed call is kept
+    bool failed = false;
+
+    code_writer(int fd, size_t size_hint);
+    code_writer(const code_writer &) = delete;
+    code_writer &operator=(const code_writer &) = delete;
+    ~code_writer();
+};
+
+void write_text_slow(code_writer *w, std::string_view s);
+// Write out buffered text, returns false if any write failed
+bool flush_writer(code_writer *w);
+
+inline void write_text(code_writer *w, std::string_view s)
+{
+    if (s.size() > (size_t) (w->end - w->curr)) {
+        write_text_slow(w, s);
+        return;
+    }
+    memcpy(w->curr, s.data(), s.size());
+    w->curr += s.size();
+}
+
+// Upper estimate of the size of the C code of the unit in bytes
+size_t estimate_c_size(context *ctx, const mod_unit *unit);
+// Returns false if writing failed, errno is set
+bool emit_c(context *ctx, const mod_unit *unit, int fd);
+
+/**
+ * Path of the C code of a source file in the output directory: the source path with ".c" for
+ * ".owl", so files of the same name in different directories do not collide. A leading '/' and
+ * "." components are dropped, ".." components become "__". Different source paths may still map
+ * to one output path ("x.owl" and "./x.owl"), the driver rejects those.
+ */
+std::string c_output_path(const std::string &dir, const std::string &file_name);
+// Writes C code to c_output_path() of the file of the context
+bool emit_c_file(context *ctx, const mod_unit *unit);
+
+} // owl
+
+#endif
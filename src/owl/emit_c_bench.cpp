@@ -0,0 +1,51 @@
+#include "owl/arena.hpp"
+#include "owl/bench.hpp"
+#include "owl/deduce_types.hpp"
+#include "owl/emit_c.hpp"
+#include "owl/lexer.hpp"
+#include "owl/parser.hpp"
+#include "owl/symbols.hpp"
+#include "owl/types.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace owl;
+
+// Model is built and its types are resolved once, code is written to /dev/null
+static bool bench_emit_c(context *ctx, std::string_view code, bench_result *r)
+{
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    arena node_arena;
+    symbol_table symbols;
+    ctx->symbols = &symbols;
+    type_table types(&symbols);
+    ctx->types = &types;
+
+    token_stream tokens;
+    token_stream_init(&tokens, ctx, code, source);
+    mod_unit *unit = parse(ctx, &node_arena, &tokens);
+
+    bool result = false;
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (fd >= 0 && unit && !tokens.failed && deduce_types(ctx, unit)) {
+        size_t n = count_nodes(ctx, unit);
+        r->unit = "nodes";
+        result = bench_loop(&bench_opts, r, [&]() -> size_t {
+            return emit_c(ctx, unit, fd) ? n : 0;
+        });
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    remove_source(global_sources(), source);
+    ctx->symbols = nullptr;
+    ctx->types = nullptr;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "emit_c", &bench_emit_c);
+}
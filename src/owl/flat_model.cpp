@@ -0,0 +1,671 @@
+#include "owl/flat_model.hpp"
+
+#include "owl/symbols.hpp"
+
+#include <assert.h>
+#include <string.h>
+
+#include <string_view>
+#include <type_traits>
+
+namespace owl {
+
+// Nodes are hashed and compared as memory
+static_assert(std::has_unique_object_representations_v<flat_function>);
+static_assert(std::has_unique_object_representations_v<flat_variable>);
+static_assert(std::has_unique_object_representations_v<flat_object>);
+static_assert(std::has_unique_object_representations_v<flat_struct>);
+static_assert(std::has_unique_object_representations_v<flat_type>);
+static_assert(std::has_unique_object_representations_v<flat_body>);
+static_assert(std::has_unique_object_representations_v<flat_stmt_return>);
+static_assert(std::has_unique_object_representations_v<flat_expr_apply>);
+static_assert(std::has_unique_object_representations_v<flat_expr_value>);
+static_assert(std::has_unique_object_representations_v<flat_unit>);
+
+struct flatten_ctx {
+    flat_model *m = nullptr;
+    bool failed = false;
+};
+
+static flat_ref flatten_node(flatten_ctx *ctx, const mod_node *node);
+
+// Children are flattened before the node, so node arrays do not grow while a node is filled in
+template <typename T>
+static flat_ref add_node(flatten_ctx *ctx, mod_node_t kind, std::vector<T> *nodes, const T &node)
+{
+    if (nodes->size() >= FLAT_MAX_NODES) {
+        ctx->failed = true;
+        return NO_REF;
+    }
+
+    nodes->push_back(node);
+    return make_ref(kind, nodes->size() - 1);
+}
+
+// List range is reserved first, nested lists follow it
+template <typename T>
+static flat_list flatten_list(flatten_ctx *ctx, const arena_vector<T *> &list)
+{
+    auto &children = ctx->m->children;
+
+    flat_list l;
+    if (children.size() + list.size() > UINT32_MAX) {
+        ctx->failed = true;
+        return l;
+    }
+
+    l.start = children.size();
+    l.count = list.size();
+    children.resize(children.size() + list.size());
+    for (size_t i = 0; i < list.size(); i++) {
+        flat_ref r = flatten_node(ctx, list[i]);
+        children[l.start + i] = r;
+    }
+    return l;
+}
+
+static flat_ref flatten_node(flatten_ctx *ctx, const mod_node *node)
+{
+    if (!node || ctx->failed) {
+        return NO_REF;
+    }
+
+    flat_model *m = ctx->m;
+    switch (node->type) {
+    case MOD_FUNCTION: {
+        auto *e = (const mod_function *) node;
+        flat_function f;
+        f.loc = e->loc;
+        f.name = e->name;
+        f.data_type = flatten_node(ctx, e->data_type);
+        f.body = flatten_node(ctx, e->body);
+        return add_node(ctx, MOD_FUNCTION, &m->functions, f);
+    }
+
+    case MOD_VARIABLE: {
+        auto *e = (const mod_variable *) node;
+        flat_variable f;
+        f.loc = e->loc;
+        f.name = e->name;
+        f.data_type = flatten_node(ctx, e->data_type);
+        f.init_expr = flatten_node(ctx, e->init_expr);
+        f.flags = e->auto_var ? FLAT_AUTO_VAR : 0;
+        return add_node(ctx, MOD_VARIABLE, &m->variables, f);
+    }
+
+    case MOD_OBJECT: {
+        auto *e = (const mod_object *) node;
+        flat_object f;
+        f.loc = e->loc;
+        f.name = e->name;
+        f.fields = flatten_list(ctx, e->fields);
+        f.flags = (e->c_layout ? FLAT_C_LAYOUT : 0) | (e->soa ? FLAT_SOA : 0);
+        return add_node(ctx, MOD_OBJECT, &m->objects, f);
+    }
+
+    case MOD_STRUCT: {
+        auto *e = (const mod_struct *) node;
+        flat_struct f;
+        f.loc = e->loc;
+        f.name = e->name;
+        return add_node(ctx, MOD_STRUCT, &m->structs, f);
+    }
+
+    case MOD_TYPE: {
+        auto *e = (const mod_type *) node;
+        flat_type f;
+        f.loc = e->loc;
+        f.name = e->name;
+        return add_node(ctx, MOD_TYPE, &m->types, f);
+    }
+
+    case MOD_BODY: {
+        auto *e = (const mod_body *) node;
+        flat_body f;
+        f.loc = e->loc;
+        f.statements = flatten_list(ctx, e->statements);
+        return add_node(ctx, MOD_BODY, &m->bodies, f);
+    }
+
+    case MOD_STMT_RETURN: {
+        auto *e = (const mod_stmt_return *) node;
+        flat_stmt_return f;
+        f.loc = e->loc;
+        f.expr = flatten_node(ctx, e->expr);
+        return add_node(ctx, MOD_STMT_RETURN, &m->stmt_returns, f);
+    }
+
+    case MOD_EXPR_APPLY: {
+        auto *e = (const mod_expr_apply *) node;
+        flat_expr_apply f;
+        f.loc = e->loc;
+        f.data_type = flatten_node(ctx, e->data_type);
+        f.name = e->name;
+        f.args = flatten_list(ctx, e->args);
+        return add_node(ctx, MOD_EXPR_APPLY, &m->expr_applies, f);
+    }
+
+    case MOD_EXPR_VALUE: {
+        auto *e = (const mod_expr_value *) node;
+        flat_expr_value f;
+        f.loc = e->loc;
+        f.data_type = flatten_node(ctx, e->data_type);
+        f.value = e->value;
+        return add_node(ctx, MOD_EXPR_VALUE, &m->expr_values, f);
+    }
+
+    default:
+        // Units do not nest
+        assert(false);
+        return NO_REF;
+    }
+}
+
+bool flatten(const mod_unit *unit, flat_model *m)
+{
+    *m = flat_model();
+
+    flatten_ctx f_ctx;
+    f_ctx.m = m;
+
+    m->unit.loc = unit->loc;
+    m->unit.functions = flatten_list(&f_ctx, unit->functions);
+    m->unit.variables = flatten_list(&f_ctx, unit->variables);
+    m->unit.objects = flatten_list(&f_ctx, unit->objects);
+    m->unit.structs = flatten_list(&f_ctx, unit->structs);
+
+    if (f_ctx.failed) {
+        *m = flat_model();
+        return false;
+    }
+    return true;
+}
+
+struct expand_ctx {
+    const flat_view *m = nullptr;
+    arena *node_arena = nullptr;
+};
+
+static mod_node *expand_node(expand_ctx *ctx, flat_ref r);
+
+template <typename T>
+static T *expand_as(expand_ctx *ctx, flat_ref r)
+{
+    return (T *) expand_node(ctx, r);
+}
+
+template <typename T>
+static void expand_list(expand_ctx *ctx, flat_list l, arena_vector<T *> *list)
+{
+    list->reserve(l.count);
+    for (uint32_t i = 0; i < l.count; i++) {
+        list->push_back(expand_as<T>(ctx, ctx->m->children[l.start + i]));
+    }
+}
+
+static mod_node *expand_node(expand_ctx *ctx, flat_ref r)
+{
+    const flat_view *m = ctx->m;
+    uint32_t i = ref_index(r);
+
+    switch (ref_kind(r)) {
+    case MOD_NULL:
+        return nullptr;
+
+    case MOD_FUNCTION: {
+        auto &f = m->functions[i];
+        auto *e = arena_new<mod_function>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->name = f.name;
+        e->data_type = expand_as<mod_type>(ctx, f.data_type);
+        e->body = expand_as<mod_body>(ctx, f.body);
+        return e;
+    }
+
+    case MOD_VARIABLE: {
+        auto &f = m->variables[i];
+        auto *e = arena_new<mod_variable>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->name = f.name;
+        e->data_type = expand_as<mod_type>(ctx, f.data_type);
+        e->init_expr = expand_as<mod_expr>(ctx, f.init_expr);
+        e->auto_var = (f.flags & FLAT_AUTO_VAR) != 0;
+        return e;
+    }
+
+    case MOD_OBJECT: {
+        auto &f = m->objects[i];
+        auto *e = arena_new<mod_object>(ctx->node_arena, ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->name = f.name;
+        expand_list(ctx, f.fields, &e->fields);
+        e->c_layout = (f.flags & FLAT_C_LAYOUT) != 0;
+        e->soa = (f.flags & FLAT_SOA) != 0;
+        return e;
+    }
+
+    case MOD_STRUCT: {
+        auto &f = m->structs[i];
+        auto *e = arena_new<mod_struct>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->name = f.name;
+        return e;
+    }
+
+    case MOD_TYPE: {
+        auto &f = m->types[i];
+        auto *e = arena_new<mod_type>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->name = f.name;
+        return e;
+    }
+
+    case MOD_BODY: {
+        auto &f = m->bodies[i];
+        auto *e = arena_new<mod_body>(ctx->node_arena, ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        expand_list(ctx, f.statements, &e->statements);
+        return e;
+    }
+
+    case MOD_STMT_RETURN: {
+        auto &f = m->stmt_returns[i];
+        auto *e = arena_new<mod_stmt_return>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->expr = expand_as<mod_expr>(ctx, f.expr);
+        return e;
+    }
+
+    case MOD_EXPR_APPLY: {
+        auto &f = m->expr_applies[i];
+        auto *e = arena_new<mod_expr_apply>(ctx->node_arena, ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->data_type = expand_as<mod_type>(ctx, f.data_type);
+        e->name = f.name;
+        expand_list(ctx, f.args, &e->args);
+        return e;
+    }
+
+    case MOD_EXPR_VALUE: {
+        auto &f = m->expr_values[i];
+        auto *e = arena_new<mod_expr_value>(ctx->node_arena);
+        e->loc = view_loc(m, f.loc);
+        e->data_type = expand_as<mod_type>(ctx, f.data_type);
+        e->value = f.value;
+        return e;
+    }
+
+    default:
+        assert(false);
+        return nullptr;
+    }
+}
+
+flat_view view_model(const flat_model *m)
+{
+    flat_view v;
+    v.functions = m->functions;
+    v.variables = m->variables;
+    v.objects = m->objects;
+    v.structs = m->structs;
+    v.types = m->types;
+    v.bodies = m->bodies;
+    v.stmt_returns = m->stmt_returns;
+    v.expr_applies = m->expr_applies;
+    v.expr_values = m->expr_values;
+    v.children = m->children;
+    v.unit = m->unit;
+    return v;
+}
+
+mod_unit *expand(const flat_view *m, arena *a)
+{
+    expand_ctx e_ctx;
+    e_ctx.m = m;
+    e_ctx.node_arena = a;
+
+    auto *e = arena_new<mod_unit>(a, a);
+    e->loc = view_loc(m, m->unit.loc);
+    expand_list(&e_ctx, m->unit.functions, &e->functions);
+    expand_list(&e_ctx, m->unit.variables, &e->variables);
+    expand_list(&e_ctx, m->unit.objects, &e->objects);
+    expand_list(&e_ctx, m->unit.structs, &e->structs);
+    return e;
+}
+
+template <typename T>
+static void rebase_array(std::vector<T> *nodes, source_loc from, source_loc to)
+{
+    for (auto &n : *nodes) {
+        if (n.loc != NO_LOC) {
+            n.loc = n.loc - from + to;
+        }
+    }
+}
+
+void rebase_model(flat_model *m, source_loc from, source_loc to)
+{
+    rebase_array(&m->functions, from, to);
+    rebase_array(&m->variables, from, to);
+    rebase_array(&m->objects, from, to);
+    rebase_array(&m->structs, from, to);
+    rebase_array(&m->types, from, to);
+    rebase_array(&m->bodies, from, to);
+    rebase_array(&m->stmt_returns, from, to);
+    rebase_array(&m->expr_applies, from, to);
+    rebase_array(&m->expr_values, from, to);
+    if (m->unit.loc != NO_LOC) {
+        m->unit.loc = m->unit.loc - from + to;
+    }
+}
+
+template <typename F>
+static void for_each_symbol(flat_model *m, F f)
+{
+    for (auto &n : m->functions) {
+        f(&n.name);
+    }
+    for (auto &n : m->variables) {
+        f(&n.name);
+    }
+    for (auto &n : m->objects) {
+        f(&n.name);
+    }
+    for (auto &n : m->structs) {
+        f(&n.name);
+    }
+    for (auto &n : m->types) {
+        f(&n.name);
+    }
+    for (auto &n : m->expr_applies) {
+        f(&n.name);
+    }
+    for (auto &n : m->expr_values) {
+        f(&n.value);
+    }
+}
+
+std::vector<symbol_id> compact_symbols(flat_model *m, size_t n_symbols)
+{
+    std::vector<symbol_id> new_ids(n_symbols, NO_SYMBOL);
+    for_each_symbol(m, [&](symbol_id *id) {
+        assert(*id < n_symbols);
+        new_ids[*id] = 1;
+    });
+
+    std::vector<symbol_id> old_ids{NO_SYMBOL};
+    for (size_t i = 1; i < n_symbols; i++) {
+        if (new_ids[i]) {
+            new_ids[i] = old_ids.size();
+            old_ids.push_back(i);
+        }
+    }
+    new_ids[NO_SYMBOL] = NO_SYMBOL;
+
+    for_each_symbol(m, [&](symbol_id *id) { *id = new_ids[*id]; });
+    return old_ids;
+}
+
+struct check_ctx {
+    const flat_view *m = nullptr;
+    uint32_t n_symbols = 0;
+    // Parent count of every node, indexed by kind
+    std::vector<uint8_t> seen[MOD_SIZE];
+    bool ok = true;
+};
+
+static size_t kind_size(const flat_view *m, mod_node_t kind)
+{
+    switch (kind) {
+    case MOD_FUNCTION:
+        return m->functions.size();
+    case MOD_VARIABLE:
+        return m->variables.size();
+    case MOD_OBJECT:
+        return m->objects.size();
+    case MOD_STRUCT:
+        return m->structs.size();
+    case MOD_TYPE:
+        return m->types.size();
+    case MOD_BODY:
+        return m->bodies.size();
+    case MOD_STMT_RETURN:
+        return m->stmt_returns.size();
+    case MOD_EXPR_APPLY:
+        return m->expr_applies.size();
+    case MOD_EXPR_VALUE:
+        return m->expr_values.size();
+    default:
+        return 0;
+    }
+}
+
+// Reference of a node to its child, optionally restricted to a kind
+static void check_ref(check_ctx *ctx, flat_ref r, mod_node_t kind = MOD_NULL)
+{
+    if (r == NO_REF) {
+        return;
+    }
+
+    mod_node_t k = ref_kind(r);
+    uint32_t i = ref_index(r);
+    if (i >= kind_size(ctx->m, k) || (kind != MOD_NULL && k != kind) || ctx->seen[k][i]++) {
+        ctx->ok = false;
+    }
+}
+
+static void check_symbol(check_ctx *ctx, symbol_id id)
+{
+    if (id >= ctx->n_symbols) {
+        ctx->ok = false;
+    }
+}
+
+static void check_expr(check_ctx *ctx, flat_ref r)
+{
+    if (r != NO_REF && ref_kind(r) != MOD_EXPR_APPLY && ref_kind(r) != MOD_EXPR_VALUE) {
+        ctx->ok = false;
+        return;
+    }
+    check_ref(ctx, r);
+}
+
+static void check_list(check_ctx *ctx, flat_list l, mod_node_t kind = MOD_NULL)
+{
+    if (l.start > ctx->m->children.size() || l.count > ctx->m->children.size() - l.start) {
+        ctx->ok = false;
+        return;
+    }
+    for (uint32_t i = 0; i < l.count; i++) {
+        check_ref(ctx, ctx->m->children[l.start + i], kind);
+    }
+}
+
+bool check_model(const flat_view *m, uint32_t n_symbols)
+{
+    check_ctx ctx;
+    ctx.m = m;
+    ctx.n_symbols = n_symbols;
+    for (int k = 0; k < MOD_SIZE; k++) {
+        ctx.seen[k].resize(kind_size(m, (mod_node_t) k));
+    }
+
+    for (auto &f : m->functions) {
+        check_symbol(&ctx, f.name);
+        check_ref(&ctx, f.data_type, MOD_TYPE);
+        check_ref(&ctx, f.body, MOD_BODY);
+    }
+    for (auto &f : m->variables) {
+        check_symbol(&ctx, f.name);
+        check_ref(&ctx, f.data_type, MOD_TYPE);
+        check_expr(&ctx, f.init_expr);
+    }
+    for (auto &f : m->objects) {
+        check_symbol(&ctx, f.name);
+        check_list(&ctx, f.fields, MOD_VARIABLE);
+    }
+    for (auto &f : m->structs) {
+        check_symbol(&ctx, f.name);
+    }
+    for (auto &f : m->types) {
+        check_symbol(&ctx, f.name);
+    }
+    for (auto &f : m->bodies) {
+        check_list(&ctx, f.statements, MOD_STMT_RETURN);
+    }
+    for (auto &f : m->stmt_returns) {
+        check_expr(&ctx, f.expr);
+    }
+    for (auto &f : m->expr_applies) {
+        check_symbol(&ctx, f.name);
+        check_ref(&ctx, f.data_type, MOD_TYPE);
+        check_list(&ctx, f.args, MOD_VARIABLE);
+    }
+    for (auto &f : m->expr_values) {
+        check_symbol(&ctx, f.value);
+        check_ref(&ctx, f.data_type, MOD_TYPE);
+    }
+    check_list(&ctx, m->unit.functions, MOD_FUNCTION);
+    check_list(&ctx, m->unit.variables, MOD_VARIABLE);
+    check_list(&ctx, m->unit.objects, MOD_OBJECT);
+    check_list(&ctx, m->unit.structs, MOD_STRUCT);
+
+    return ctx.ok;
+}
+
+static uint64_t hash_bytes(uint64_t h, const void *data, size_t size)
+{
+    return (h ^ hash_string(std::string_view((const char *) data, size)) ^ size) * 0x100000001b3;
+}
+
+template <typename T>
+static uint64_t hash_array(uint64_t h, const std::vector<T> &nodes)
+{
+    return hash_bytes(h, nodes.data(), nodes.size() * sizeof(T));
+}
+
+uint64_t hash_model(const flat_model *m)
+{
+    uint64_t h = 0xcbf29ce484222325;
+    h = hash_array(h, m->functions);
+    h = hash_array(h, m->variables);
+    h = hash_array(h, m->objects);
+    h = hash_array(h, m->structs);
+    h = hash_array(h, m->types);
+    h = hash_array(h, m->bodies);
+    h = hash_array(h, m->stmt_returns);
+    h = hash_array(h, m->expr_applies);
+    h = hash_array(h, m->expr_values);
+    h = hash_array(h, m->children);
+    h = hash_bytes(h, &m->unit, sizeof(flat_unit));
+    return h;
+}
+
+template <typename T>
+static bool equal_arrays(const std::vector<T> &nodes1, const std::vector<T> &nodes2)
+{
+    return nodes1.size() == nodes2.size()
+            && memcmp(nodes1.data(), nodes2.data(), nodes1.size() * sizeof(T)) == 0;
+}
+
+bool equal_models(const flat_model *m1, const flat_model *m2)
+{
+    return equal_arrays(m1->functions, m2->functions)
+            && equal_arrays(m1->variables, m2->variables)
+            && equal_arrays(m1->objects, m2->objects)
+            && equal_arrays(m1->structs, m2->structs)
+            && equal_arrays(m1->types, m2->types)
+            && equal_arrays(m1->bodies, m2->bodies)
+            && equal_arrays(m1->stmt_returns, m2->stmt_returns)
+            && equal_arrays(m1->expr_applies, m2->expr_applies)
+            && equal_arrays(m1->expr_values, m2->expr_values)
+            && equal_arrays(m1->children, m2->children)
+            && memcmp(&m1->unit, &m2->unit, sizeof(flat_unit)) == 0;
+}
+
+static void visit_ref(const flat_visitor *v, void *bind, const flat_view *m, flat_ref r)
+{
+    if (r != NO_REF) {
+        v->visit[ref_kind(r)](v, bind, flat_node{m, r});
+    }
+}
+
+static void visit_list(const flat_visitor *v, void *bind, const flat_view *m, flat_list l)
+{
+    for (uint32_t i = 0; i < l.count; i++) {
+        visit_ref(v, bind, m, m->children[l.start + i]);
+    }
+}
+
+static void default_flat_visit(const flat_visitor *v, void *bind, flat_node node)
+{
+    visit_children(v, bind, node);
+}
+
+flat_visitor::flat_visitor(context *ctx): root_ctx{ctx}
+{
+    for (int i = 0; i < MOD_SIZE; i++) {
+        visit[i] = &default_flat_visit;
+    }
+}
+
+void visit_children(const flat_visitor *v, void *bind, flat_node node)
+{
+    const flat_view *m = node.m;
+    uint32_t i = ref_index(node.ref);
+
+    switch (ref_kind(node.ref)) {
+    case MOD_FUNCTION:
+        visit_ref(v, bind, m, m->functions[i].data_type);
+        visit_ref(v, bind, m, m->functions[i].body);
+        break;
+
+    case MOD_VARIABLE:
+        visit_ref(v, bind, m, m->variables[i].data_type);
+        visit_ref(v, bind, m, m->variables[i].init_expr);
+        break;
+
+    case MOD_OBJECT:
+        visit_list(v, bind, m, m->objects[i].fields);
+        break;
+
+    case MOD_BODY:
+        visit_list(v, bind, m, m->bodies[i].statements);
+        break;
+
+    case MOD_STMT_RETURN:
+        visit_ref(v, bind, m, m->stmt_returns[i].expr);
+        break;
+
+    case MOD_EXPR_APPLY:
+        visit_ref(v, bind, m, m->expr_applies[i].data_type);
+        break;
+
+    case MOD_EXPR_VALUE:
+        visit_ref(v, bind, m, m->expr_values[i].data_type);
+        break;
+
+    case MOD_UNIT:
+        visit_list(v, bind, m, m->unit.functions);
+        visit_list(v, bind, m, m->unit.variables);
+        visit_list(v, bind, m, m->unit.objects);
+        visit_list(v, bind, m, m->unit.structs);
+        break;
+
+    default:
+        // Structs and types have no children
+        break;
+    }
+}
+
+void visit(const flat_visitor *v, void *bind, flat_node node)
+{
+    visit_ref(v, bind, node.m, node.ref);
+}
+
+void visit(const flat_visitor *v, void *bind, const flat_view *m)
+{
+    visit_ref(v, bind, m, UNIT_REF);
+}
+
+} // owl
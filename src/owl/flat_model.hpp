@@ -0,0 +1,247 @@
+#ifndef OWL_FLAT_MODEL_HPP
+#define OWL_FLAT_MODEL_HPP
+
+#include "owl/arena.hpp"
+#include "owl/context.hpp"
+#include "owl/model.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Flat model. Same graph as the model, but nodes of every kind are stored in an array of their
+ * own and refer to each other by 32-bit references instead of pointers. Child lists of all nodes
+ * share a single array. The model has no pointers, so it can be copied, hashed, compared and
+ * written out as plain memory. Nodes consist of 32-bit fields only and have no padding.
+ *
+ * Names are symbol ids of the symbol table the model was built with.
+ */
+
+namespace owl {
+
+// Node kind in the top bits, index into the array of the kind in the rest
+typedef uint32_t flat_ref;
+
+constexpr int FLAT_KIND_BITS = 4;
+constexpr int FLAT_INDEX_BITS = 32 - FLAT_KIND_BITS;
+constexpr uint32_t FLAT_MAX_NODES = 1u << FLAT_INDEX_BITS;
+static_assert(MOD_SIZE <= (1 << FLAT_KIND_BITS), "node kinds do not fit into flat_ref");
+
+// Kind MOD_NULL, no node
+constexpr flat_ref NO_REF = 0;
+
+constexpr flat_ref make_ref(mod_node_t kind, uint32_t index)
+{
+    return ((uint32_t) kind << FLAT_INDEX_BITS) | index;
+}
+
+constexpr mod_node_t ref_kind(flat_ref r)
+{
+    return (mod_node_t) (r >> FLAT_INDEX_BITS);
+}
+
+constexpr uint32_t ref_index(flat_ref r)
+{
+    return r & (FLAT_MAX_NODES - 1);
+}
+
+// Range of flat_model::children
+struct flat_list {
+    uint32_t start = 0;
+    uint32_t count = 0;
+};
+
+struct flat_function {
+    source_loc loc = NO_LOC;
+    symbol_id name = NO_SYMBOL;
+    flat_ref data_type = NO_REF;
+    flat_ref body = NO_REF;
+};
+
+// flat_variable::flags
+constexpr uint32_t FLAT_AUTO_VAR = 1;
+
+struct flat_variable {
+    source_loc loc = NO_LOC;
+    symbol_id name = NO_SYMBOL;
+    flat_ref data_type = NO_REF;
+    flat_ref init_expr = NO_REF;
+    uint32_t flags = 0;
+};
+
+// flat_object::flags
+constexpr uint32_t FLAT_C_LAYOUT = 1;
+constexpr uint32_t FLAT_SOA = 2;
+
+struct flat_object {
+    source_loc loc = NO_LOC;
+    symbol_id name = NO_SYMBOL;
+    flat_list fields;
+    uint32_t flags = 0;
+};
+
+struct flat_struct {
+    source_loc loc = NO_LOC;
+    symbol_id name = NO_SYMBOL;
+};
+
+// Type definition is resolved by passes, it is not part of the flat model
+struct flat_type {
+    source_loc loc = NO_LOC;
+    symbol_id name = NO_SYMBOL;
+};
+
+struct flat_body {
+    source_loc loc = NO_LOC;
+    flat_list statements;
+};
+
+struct flat_stmt_return {
+    source_loc loc = NO_LOC;
+    flat_ref expr = NO_REF;
+};
+
+struct flat_expr_apply {
+    source_loc loc = NO_LOC;
+    flat_ref data_type = NO_REF;
+    symbol_id name = NO_SYMBOL;
+    flat_list args;
+};
+
+struct flat_expr_value {
+    source_loc loc = NO_LOC;
+    flat_ref data_type = NO_REF;
+    symbol_id value = NO_SYMBOL;
+};
+
+struct flat_unit {
+    source_loc loc = NO_LOC;
+    flat_list functions;
+    flat_list variables;
+    flat_list objects;
+    flat_list structs;
+};
+
+struct flat_model {
+    std::vector<flat_function> functions;
+    std::vector<flat_variable> variables;
+    std::vector<flat_object> objects;
+    std::vector<flat_struct> structs;
+    std::vector<flat_type> types;
+    std::vector<flat_body> bodies;
+    std::vector<flat_stmt_return> stmt_returns;
+    std::vector<flat_expr_apply> expr_applies;
+    std::vector<flat_expr_value> expr_values;
+
+    // Child lists of all nodes
+    std::vector<flat_ref> children;
+
+    flat_unit unit;
+};
+
+// Array of a flat_view, in a flat_model or in a mapped cache file
+template <typename T>
+struct flat_span {
+    const T *items = nullptr;
+    size_t count = 0;
+
+    flat_span() = default;
+    flat_span(const T *items, size_t count): items{items}, count{count} {}
+    flat_span(const std::vector<T> &v): items{v.data()}, count{v.size()} {}
+
+    size_t size() const { return count; }
+    const T &operator[](size_t i) const { return items[i]; }
+    const T *begin() const { return items; }
+    const T *end() const { return items + count; }
+};
+
+/**
+ * Read-only flat model in memory owned elsewhere, such as a model cache file mapped into memory,
+ * so it is used in place instead of being copied. Locations may be stored relative to the source,
+ * view_loc() moves them to the source when nodes are read.
+ */
+struct flat_view {
+    flat_span<flat_function> functions;
+    flat_span<flat_variable> variables;
+    flat_span<flat_object> objects;
+    flat_span<flat_struct> structs;
+    flat_span<flat_type> types;
+    flat_span<flat_body> bodies;
+    flat_span<flat_stmt_return> stmt_returns;
+    flat_span<flat_expr_apply> expr_applies;
+    flat_span<flat_expr_value> expr_values;
+    flat_span<flat_ref> children;
+
+    flat_unit unit;
+
+    // Added to stored locations, locations at or after shift_from are moved by shift as well
+    int64_t loc_delta = 0;
+    source_loc shift_from = NO_LOC;
+    int64_t shift = 0;
+};
+
+flat_view view_model(const flat_model *m);
+
+inline source_loc view_loc(const flat_view *v, source_loc loc)
+{
+    if (loc == NO_LOC) {
+        return NO_LOC;
+    }
+    return loc + v->loc_delta + (loc >= v->shift_from ? v->shift : 0);
+}
+
+// Build flat model of the unit, returns false if there are too many nodes
+bool flatten(const mod_unit *unit, flat_model *m);
+
+// Build model nodes in the arena
+mod_unit *expand(const flat_view *m, arena *a);
+
+// Move node locations from source at base from to source at base to
+void rebase_model(flat_model *m, source_loc from, source_loc to);
+
+// Renumber the symbols the model uses from 1, in id order. Returns the old id of every new one,
+// index 0 is NO_SYMBOL.
+std::vector<symbol_id> compact_symbols(flat_model *m, size_t n_symbols);
+
+// Check that references, lists and symbol ids (below n_symbols) are in range and every node has at
+// most one parent, for models read from files
+bool check_model(const flat_view *m, uint32_t n_symbols);
+
+uint64_t hash_model(const flat_model *m);
+bool equal_models(const flat_model *m1, const flat_model *m2);
+
+/**
+ * Visitor of flat models, the counterpart of visitor. Handlers are looked up by the kind of the
+ * reference and see the node in place, in the arrays of the model; the default handler visits the
+ * children. Nodes are visited in the same order as by visitor. Flat models are read-only, so
+ * handlers cannot replace nodes.
+ */
+struct flat_node {
+    const flat_view *m = nullptr;
+    flat_ref ref = NO_REF;
+};
+
+// Unit is the root of every flat model
+constexpr flat_ref UNIT_REF = make_ref(MOD_UNIT, 0);
+
+struct flat_visitor;
+
+typedef void (*flat_visit_fn)(const flat_visitor *v, void *bind, flat_node node);
+
+struct flat_visitor {
+    context *root_ctx = nullptr;
+    flat_visit_fn visit[MOD_SIZE] = {};
+
+    explicit flat_visitor(context *ctx);
+};
+
+void visit_children(const flat_visitor *v, void *bind, flat_node node);
+void visit(const flat_visitor *v, void *bind, flat_node node);
+// Visits the whole model, starting with the unit
+void visit(const flat_visitor *v, void *bind, const flat_view *m);
+
+} // owl
+
+#endif
@@ -0,0 +1,29 @@
+#include "owl/flat_model.hpp"
+#include "owl/symbols.hpp"
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+using namespace owl;
+
+TEST(flat_model, compact_symbols)
+{
+    flat_model m;
+    m.functions.resize(2);
+    m.functions[0].name = 7;
+    m.functions[1].name = 3;
+    m.variables.resize(1);
+    m.variables[0].name = 7;
+    m.expr_values.resize(1);
+    m.expr_values[0].value = 5;
+    m.expr_applies.resize(1);
+
+    std::vector<symbol_id> old_ids = compact_symbols(&m, 10);
+    EXPECT_EQ(old_ids, (std::vector<symbol_id>{NO_SYMBOL, 3, 5, 7}));
+    EXPECT_EQ(m.functions[0].name, 3u);
+    EXPECT_EQ(m.functions[1].name, 1u);
+    EXPECT_EQ(m.variables[0].name, 3u);
+    EXPECT_EQ(m.expr_values[0].value, 2u);
+    EXPECT_EQ(m.expr_applies[0].name, NO_SYMBOL);
+}
@@ -1,9 +1,358 @@
 #include "owl/lexer.hpp"
 
-#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 namespace owl {
 
+enum char_class : uint8_t {
+    CHAR_INVALID = 0,
+    CHAR_SPACE = 1 << 0,
+    CHAR_ALPHA = 1 << 1, // Letters and '_'
+    CHAR_DIGIT = 1 << 2,
+    CHAR_PUNCT = 1 << 3, // Single character token
+    CHAR_COMMENT = 1 << 4,
+    CHAR_QUOTE = 1 << 5,
+};
+
+struct char_table {
+    uint8_t char_class[256] = {};
+    token_t punct[256] = {};
+};
+
+static constexpr char_table make_char_table()
+{
+    char_table t;
+    for (int c = 'a'; c <= 'z'; c++) {
+        t.char_class[c] = CHAR_ALPHA;
+        t.char_class[c - 'a' + 'A'] = CHAR_ALPHA;
+    }
+    t.char_class['_'] = CHAR_ALPHA;
+    for (int c = '0'; c <= '9'; c++) {
+        t.char_class[c] = CHAR_DIGIT;
+    }
+    for (int c : {' ', '\t', '\n', '\v', '\f', '\r'}) {
+        t.char_class[c] = CHAR_SPACE;
+    }
+    t.char_class['#'] = CHAR_COMMENT;
+    t.char_class['"'] = CHAR_QUOTE;
+
+    const struct {
+        char c;
+        token_t tok;
+    } punct[] = {
+            {'(', TOKEN_LPAREN},
+            {')', TOKEN_RPAREN},
+            {'{', TOKEN_LCURLY},
+            {'}', TOKEN_RCURLY},
+            {'[', TOKEN_LINDEX},
+            {']', TOKEN_RINDEX},
+            {',', TOKEN_COMMA},
+            {':', TOKEN_COLON},
+            {';', TOKEN_SEMICOLON},
+            {'=', TOKEN_EQ},
+    };
+    for (auto p : punct) {
+        t.char_class[(uint8_t) p.c] = CHAR_PUNCT;
+        t.punct[(uint8_t) p.c] = p.tok;
+    }
+    return t;
+}
+
+static constexpr char_table chars = make_char_table();
+
+static inline uint8_t class_of(char c)
+{
+    return chars.char_class[(uint8_t) c];
+}
+
+// Vector fast paths for comments and strings, which run for many bytes. vec_* functions classify
+// VEC_SIZE bytes and return a bit mask with bit i set if byte i is in the class. Scanners run vector
+// loop while there is a full vector of input left and finish with the table.
+#if defined(__AVX2__)
+#define VEC_SIZE 32
+
+typedef __m256i vec;
+
+static inline vec vec_load(const char *p)
+{
+    return _mm256_loadu_si256((const __m256i *) p);
+}
+
+static inline uint64_t vec_eq(vec v, char c)
+{
+    return (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)));
+}
+
+// Non-ASCII bytes
+static inline uint64_t vec_high(vec v)
+{
+    return (uint32_t) _mm256_movemask_epi8(v);
+}
+#elif defined(__SSE2__)
+#define VEC_SIZE 16
+
+typedef __m128i vec;
+
+static inline vec vec_load(const char *p)
+{
+    return _mm_loadu_si128((const __m128i *) p);
+}
+
+static inline uint64_t vec_eq(vec v, char c)
+{
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)));
+}
+
+static inline uint64_t vec_high(vec v)
+{
+    return (uint32_t) _mm_movemask_epi8(v);
+}
+#endif
+
+// Keywords are looked up in a perfect hash table. Hash combines the length, the first and the last
+// character with a multiplicative hash, the multiplier is found at compile time.
+struct keyword {
+    std::string_view text;
+    token_t tok;
+};
+
+static constexpr keyword keywords[] = {
+        {KW_AUTO, TOKEN_KW_AUTO},
+        {KW_DO, TOKEN_KW_DO},
+        {KW_EXTERN, TOKEN_KW_EXTERN},
+        {KW_IF, TOKEN_KW_IF},
+        {KW_FUNC, TOKEN_KW_FUNC},
+        {KW_OBJECT, TOKEN_KW_OBJECT},
+        {KW_RETURN, TOKEN_KW_RETURN},
+        {KW_SOA, TOKEN_KW_SOA},
+        {KW_STRUCT, TOKEN_KW_STRUCT},
+        {KW_VAR, TOKEN_KW_VAR},
+};
+
+static constexpr int KW_HASH_BITS = 4;
+static constexpr size_t KW_MIN_SIZE = 2;
+static constexpr size_t KW_MAX_SIZE = 6;
+
+static constexpr uint32_t keyword_hash(uint32_t seed, std::string_view w)
+{
+    uint32_t key = (uint8_t) w[0] | (uint8_t) w[w.size() - 1] << 8 | (uint32_t) w.size() << 16;
+    return (key * seed) >> (32 - KW_HASH_BITS);
+}
+
+static constexpr uint32_t find_keyword_seed()
+{
+    for (uint32_t seed = 0x9e3779b9; seed < 0x9e3779b9 + 1000000; seed += 2) {
+        bool used[1 << KW_HASH_BITS] = {};
+        bool collision = false;
+        for (auto &kw : keywords) {
+            auto h = keyword_hash(seed, kw.text);
+            collision = collision || used[h];
+            used[h] = true;
+        }
+        if (!collision) {
+            return seed;
+        }
+    }
+    return 0;
+}
+
+static constexpr uint32_t KW_SEED = find_keyword_seed();
+static_assert(KW_SEED != 0, "no perfect hash for keywords");
+
+struct keyword_table {
+    keyword slots[1 << KW_HASH_BITS] = {};
+};
+
+static constexpr keyword_table make_keyword_table()
+{
+    keyword_table t;
+    for (auto &kw : keywords) {
+        t.slots[keyword_hash(KW_SEED, kw.text)] = kw;
+    }
+    return t;
+}
+
+static constexpr keyword_table kw_table = make_keyword_table();
+
+// Spaces, words and numbers between tokens are a few bytes long, a vector load and mask per token
+// costs more than it saves on them, so they are scanned with the table
+static void skip_space(lex_state *s)
+{
+    for (; s->i < s->size && class_of(s->code[s->i]) == CHAR_SPACE; s->i++) {
+        if (s->code[s->i] == '\n') {
+            s->source->lines.starts.push_back(s->i + 1);
+        }
+    }
+}
+
+static void skip_ident(lex_state *s)
+{
+    while (s->i < s->size && (class_of(s->code[s->i]) & (CHAR_ALPHA | CHAR_DIGIT))) {
+        s->i++;
+    }
+}
+
+static void skip_digits(lex_state *s)
+{
+    while (s->i < s->size && class_of(s->code[s->i]) == CHAR_DIGIT) {
+        s->i++;
+    }
+}
+
+static void lex_error(context *ctx, const lex_state *s, size_t pos, const char *format, ...)
+{
+    va_list va;
+    va_start(va, format);
+    compiler_error_va(ctx, s->source->base + pos, format, va);
+    va_end(va);
+}
+
+// Returns offset of the first byte that is not a part of a well-formed UTF-8 sequence, or `n` if
+// the whole text is valid. Overlong encodings, surrogates and code points above U+10FFFF are
+// rejected.
+static size_t find_invalid_utf8(const uint8_t *p, size_t n)
+{
+    size_t i = 0;
+    while (i < n) {
+        uint64_t w = 0;
+        if (i + 8 <= n && (memcpy(&w, p + i, 8), (w & 0x8080808080808080ull) == 0)) {
+            i += 8;
+            continue;
+        }
+
+        const uint8_t c = p[i];
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+
+        size_t len = 0;
+        uint32_t cp = 0;
+        uint32_t cp_min = 0;
+        if ((c & 0xe0) == 0xc0) {
+            len = 2;
+            cp = c & 0x1f;
+            cp_min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            len = 3;
+            cp = c & 0x0f;
+            cp_min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            len = 4;
+            cp = c & 0x07;
+            cp_min = 0x10000;
+        } else {
+            return i;
+        }
+
+        if (i + len > n) {
+            return i;
+        }
+        for (size_t k = 1; k < len; k++) {
+            if ((p[i + k] & 0xc0) != 0x80) {
+                return i;
+            }
+            cp = (cp << 6) | (p[i + k] & 0x3f);
+        }
+        if (cp < cp_min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+            return i;
+        }
+        i += len;
+    }
+    return n;
+}
+
+// Validate UTF-8 from `first` to the current position. Text between must be on the current line.
+static bool check_utf8(context *ctx, const lex_state *s, size_t first)
+{
+    const size_t n = s->i - first;
+    const size_t k = find_invalid_utf8((const uint8_t *) s->code + first, n);
+    if (k == n) {
+        return true;
+    }
+
+    const size_t pos = first + k;
+    lex_error(ctx, s, pos, "invalid UTF-8 sequence: ord=%d", (int) (uint8_t) s->code[pos]);
+    return false;
+}
+
+// Skip to the end of line, new line character is not consumed. Comments may contain UTF-8 text,
+// the common all-ASCII case is checked on the fly and only non-ASCII comments are validated.
+static bool skip_comment(context *ctx, lex_state *s)
+{
+    const size_t first = s->i;
+    uint64_t high = 0;
+#ifdef VEC_SIZE
+    while (s->i + VEC_SIZE <= s->size) {
+        vec v = vec_load(s->code + s->i);
+        uint64_t nl = vec_eq(v, '\n');
+        if (nl) {
+            high |= vec_high(v) & ((nl & -nl) - 1);
+            s->i += __builtin_ctzll(nl);
+            break;
+        }
+        high |= vec_high(v);
+        s->i += VEC_SIZE;
+    }
+#endif
+    for (; s->i < s->size && s->code[s->i] != '\n'; s->i++) {
+        high |= (uint8_t) s->code[s->i] & 0x80;
+    }
+    return !high || check_utf8(ctx, s, first);
+}
+
+// String literal in double quotes on a single line, '\' escapes the next character. Consumes the
+// closing quote. Like comments, may contain UTF-8 text.
+static bool skip_string(context *ctx, lex_state *s)
+{
+    const size_t first = s->i++;
+    uint64_t high = 0;
+    while (true) {
+#ifdef VEC_SIZE
+        while (s->i + VEC_SIZE <= s->size) {
+            vec v = vec_load(s->code + s->i);
+            uint64_t stop = vec_eq(v, '"') | vec_eq(v, '\\') | vec_eq(v, '\n');
+            if (stop) {
+                high |= vec_high(v) & ((stop & -stop) - 1);
+                s->i += __builtin_ctzll(stop);
+                break;
+            }
+            high |= vec_high(v);
+            s->i += VEC_SIZE;
+        }
+#endif
+        for (; s->i < s->size; s->i++) {
+            const char c = s->code[s->i];
+            if (c == '"' || c == '\\' || c == '\n') {
+                break;
+            }
+            high |= (uint8_t) c & 0x80;
+        }
+
+        if (s->i == s->size || s->code[s->i] == '\n') {
+            lex_error(ctx, s, first, "unterminated string literal");
+            return false;
+        }
+
+        if (s->code[s->i++] == '"') {
+            break;
+        }
+
+        // Escaped character
+        if (s->i < s->size && s->code[s->i] != '\n') {
+            high |= (uint8_t) s->code[s->i] & 0x80;
+            s->i++;
+        }
+    }
+    return !high || check_utf8(ctx, s, first);
+}
+
 const char *token_name(token_t tok)
 {
     // clang-format off
@@ -22,161 +371,148 @@ const char *token_name(token_t tok)
             "':'",
             "';'",
             "'='",
+            "'" KW_AUTO "'",
+            "'" KW_DO "'",
+            "'" KW_EXTERN "'",
+            "'" KW_IF "'",
+            "'" KW_FUNC "'",
+            "'" KW_OBJECT "'",
+            "'" KW_RETURN "'",
+            "'" KW_SOA "'",
+            "'" KW_STRUCT "'",
+            "'" KW_VAR "'",
     };
     // clang-format on
     return names[tok];
 }
 
-void print_token(context *ctx, const token &t)
+void print_token(context *ctx, const lex_state *s, const token *t)
 {
-    fprintf(ctx->f_debug, "%s @%i, %i", token_name(t.tok), t.lnum, t.cnum);
-    switch (t.tok) {
+    int lnum = 0;
+    int cnum = 0;
+    find_line(&s->source->lines, t->offset, &lnum, &cnum);
+
+    fprintf(ctx->f_debug, "%s @%i, %i", token_name(t->tok), lnum, cnum);
+    switch (t->tok) {
     case TOKEN_WORD:
     case TOKEN_NUMBER:
-    case TOKEN_STRING:
-        fprintf(ctx->f_debug, ": %.*s", (int) t.text.size(), t.text.data());
+    case TOKEN_STRING: {
+        auto text = token_text(s, t);
+        fprintf(ctx->f_debug, ": %.*s", (int) text.size(), text.data());
         break;
+    }
     default:
         break;
     }
     fprintf(ctx->f_debug, "\n");
 }
 
-bool tokenize(context *ctx, std::string_view code, std::vector<token> *tokens)
+// Lex the next token. Returns TOKEN_EOF at the end of code.
+static bool lex_token(context *ctx, lex_state *s, token *t)
 {
-    int lnum = 1;
-    size_t line_first = 0;
-    for (size_t i = 0; i < code.size();) {
-        int chr = code[i];
-        if (isspace(chr)) {
-            if (chr == '\n') {
-                lnum++;
-                line_first = i + 1;
-            }
-            i++;
-            continue;
-        }
+    while (true) {
+        skip_space(s);
 
-        token t;
-
-        const size_t first = i;
-        if (chr == '_' || isalpha(chr)) {
-            do {
-                i++;
-            } while (i < code.size() && (chr == '_' || isalnum(code[i])));
+        *t = token();
+        t->offset = s->i;
+        if (s->i == s->size) {
+            return true;
+        }
 
-            t.text = code.substr(first, i - first);
-            t.tok = TOKEN_WORD;
-        } else if (isdigit(chr)) {
-            do {
-                i++;
-            } while (i < code.size() && isdigit(code[i]));
+        const char chr = s->code[s->i];
+        switch (class_of(chr)) {
+        case CHAR_ALPHA:
+            s->i++;
+            skip_ident(s);
+            t->tok = keyword_token(std::string_view(s->code + t->offset, s->i - t->offset));
+            break;
 
-            if (i < code.size() && isalpha(code[i])) {
-                compiler_error_at(ctx,
-                        lnum,
-                        i - line_first + 1,
+        case CHAR_DIGIT:
+            s->i++;
+            skip_digits(s);
+            if (s->i < s->size && class_of(s->code[s->i]) == CHAR_ALPHA) {
+                lex_error(ctx,
+                        s,
+                        s->i,
                         "invalid character: '%c' ord=%d",
-                        (char) chr,
-                        chr);
+                        s->code[s->i],
+                        (int) s->code[s->i]);
                 return false;
             }
+            t->tok = TOKEN_NUMBER;
+            break;
 
-            t.text = code.substr(first, i - first);
-            t.tok = TOKEN_NUMBER;
-        } else {
-            bool comment = false;
-
-            switch (chr) {
-            case '#':
-                comment = true;
-                break;
-
-            case '(':
-                t.tok = TOKEN_LPAREN;
-                break;
-            case ')':
-                t.tok = TOKEN_RPAREN;
-                break;
-
-            case '{':
-                t.tok = TOKEN_LCURLY;
-                break;
-            case '}':
-                t.tok = TOKEN_RCURLY;
-                break;
-
-            case '[':
-                t.tok = TOKEN_LINDEX;
-                break;
-            case ']':
-                t.tok = TOKEN_RINDEX;
-                break;
-
-            case ',':
-                t.tok = TOKEN_COMMA;
-                break;
-            case ':':
-                t.tok = TOKEN_COLON;
-                break;
-            case ';':
-                t.tok = TOKEN_SEMICOLON;
-                break;
-            case '=':
-                t.tok = TOKEN_EQ;
-                break;
+        case CHAR_PUNCT:
+            s->i++;
+            t->tok = chars.punct[(uint8_t) chr];
+            break;
 
-            default:
-                compiler_error_at(ctx,
-                        lnum,
-                        i - line_first + 1,
-                        "invalid character: '%c' ord=%d",
-                        (char) chr,
-                        chr);
+        case CHAR_QUOTE:
+            if (!skip_string(ctx, s)) {
                 return false;
             }
+            t->tok = TOKEN_STRING;
+            break;
 
-            if (comment) {
-                while (i < code.size() && code[i] != '\n') {
-                    i++;
-                }
-                continue;
+        case CHAR_COMMENT:
+            if (!skip_comment(ctx, s)) {
+                return false;
             }
+            continue;
 
-            i++;
+        default:
+            lex_error(ctx, s, s->i, "invalid character: '%c' ord=%d", chr, (int) (uint8_t) chr);
+            return false;
         }
 
-        if (ctx->debug_lexer) {
-            print_token(ctx, t);
+        t->size = s->i - t->offset;
+        if (ctx->debug_lexer && ctx->f_debug) {
+            print_token(ctx, s, t);
         }
-
-        tokens->push_back(t);
+        return true;
     }
+}
 
-    token t_eof = {
-            .tok = TOKEN_EOF,
-            .lnum = lnum,
-            .cnum = 1,
-    };
-    tokens->push_back(t_eof);
+void token_stream_init(
+        token_stream *ts, context *ctx, std::string_view code, source_entry *source)
+{
+    *ts = token_stream();
+    ts->ctx = ctx;
+    ts->lex.code = code.data();
+    ts->lex.size = code.size();
+    ts->lex.source = source;
+}
 
-    return true;
+void token_stream_fill(token_stream *ts)
+{
+    token *t = &ts->window[ts->end % TOKEN_WINDOW];
+    if (ts->at_eof) {
+        // Stream ends with infinite EOF tokens
+        *t = ts->window[(ts->end - 1) % TOKEN_WINDOW];
+    } else if (!lex_token(ts->ctx, &ts->lex, t)) {
+        // Error is already reported, make parser stop
+        *t = token();
+        t->offset = ts->lex.i;
+        ts->failed = true;
+        ts->at_eof = true;
+    } else {
+        ts->at_eof = t->tok == TOKEN_EOF;
+    }
+    ts->end++;
 }
 
-bool is_keyword(std::string_view word)
+token_t keyword_token(std::string_view word)
 {
-    // TODO: Optimize by looking into first char
+    if (word.size() < KW_MIN_SIZE || word.size() > KW_MAX_SIZE) {
+        return TOKEN_WORD;
+    }
+    const keyword &kw = kw_table.slots[keyword_hash(KW_SEED, word)];
+    return kw.text == word ? kw.tok : TOKEN_WORD;
+}
 
-    // clang-format off
-    return word == KW_AUTO
-            || word == KW_DO
-            || word == KW_IF
-            || word == KW_FUNC
-            || word == KW_OBJECT
-            || word == KW_RETURN
-            || word == KW_STRUCT
-            || word == KW_VAR;
-    // clang-format on
+bool is_keyword(std::string_view word)
+{
+    return keyword_token(word) != TOKEN_WORD;
 }
 
 } // owl
@@ -2,27 +2,32 @@
 #define LEXER_HPP
 
 #include "owl/context.hpp"
+#include "owl/source.hpp"
+
+#include <stdint.h>
 
 #include <string>
 #include <string_view>
-#include <vector>
 
 /**
- * Lexer. Converts text into a vector of tokens.
+ * Lexer. Converts text into a stream of tokens. Tokens are produced on demand, the stream keeps
+ * only a small window of tokens for the parser to look ahead.
  */
 
 namespace owl {
 
 #define KW_AUTO "auto"
 #define KW_DO "do"
+#define KW_EXTERN "extern"
 #define KW_IF "if"
 #define KW_FUNC "func"
 #define KW_OBJECT "object"
 #define KW_RETURN "return"
+#define KW_SOA "soa"
 #define KW_STRUCT "struct"
 #define KW_VAR "var"
 
-enum token_t {
+enum token_t : uint8_t {
     TOKEN_EOF, // end-of-file
 
     TOKEN_WORD,
@@ -44,19 +49,84 @@ enum token_t {
     TOKEN_SEMICOLON, // ;
     TOKEN_EQ, // =
 
+    // Keywords
+    TOKEN_KW_AUTO,
+    TOKEN_KW_DO,
+    TOKEN_KW_EXTERN,
+    TOKEN_KW_IF,
+    TOKEN_KW_FUNC,
+    TOKEN_KW_OBJECT,
+    TOKEN_KW_RETURN,
+    TOKEN_KW_SOA,
+    TOKEN_KW_STRUCT,
+    TOKEN_KW_VAR,
+
     TOKEN_SIZE
 };
 
+/**
+ * Token refers to its text in the code by offset. Line and column are looked up in the line index
+ * when needed.
+ */
 struct token {
     token_t tok = TOKEN_EOF;
-    int lnum = 0;
-    int cnum = 0;
-    std::string_view text;
+    uint32_t offset = 0;
+    uint32_t size = 0;
+};
+
+// Cursor over the source code, fills line index of the source
+struct lex_state {
+    const char *code = nullptr;
+    size_t size = 0;
+    size_t i = 0;
+
+    source_entry *source = nullptr;
 };
 
-bool tokenize(context *ctx, std::string_view code, std::vector<token> *tokens);
+inline std::string_view token_text(const lex_state *s, const token *t)
+{
+    return std::string_view(s->code + t->offset, t->size);
+}
+
+// Number of tokens kept by the stream, must be a power of 2. Token returned by the stream stays
+// valid until TOKEN_WINDOW more tokens are lexed.
+constexpr size_t TOKEN_WINDOW = 4;
+
+struct token_stream {
+    context *ctx = nullptr;
+    lex_state lex;
+
+    token window[TOKEN_WINDOW];
+    size_t curr = 0; // Index of the current token
+    size_t end = 0; // Index after the last lexed token
+
+    bool at_eof = false;
+    bool failed = false; // Lexer reported an error, stream ends with EOF
+};
+
+void token_stream_init(
+        token_stream *ts, context *ctx, std::string_view code, source_entry *source);
+void token_stream_fill(token_stream *ts);
+
+// Look ahead, `ahead` must be less than TOKEN_WINDOW
+inline const token *peek_token(token_stream *ts, size_t ahead)
+{
+    while (ts->curr + ahead >= ts->end) {
+        token_stream_fill(ts);
+    }
+    return &ts->window[(ts->curr + ahead) % TOKEN_WINDOW];
+}
+
+inline const token *take_token(token_stream *ts)
+{
+    const token *t = peek_token(ts, 0);
+    ts->curr++;
+    return t;
+}
+
 const char *token_name(token_t tok);
-void print_token(context *ctx, const token &t);
+void print_token(context *ctx, const lex_state *s, const token *t);
+token_t keyword_token(std::string_view word);
 bool is_keyword(std::string_view word);
 
 } // owl
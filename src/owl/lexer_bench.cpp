@@ -0,0 +1,29 @@
+#include "owl/bench.hpp"
+#include "owl/lexer.hpp"
+
+using namespace owl;
+
+// Tokens are pulled from the stream one at a time, as the parser does
+static bool bench_lexer(context *ctx, std::string_view code, bench_result *r)
+{
+    r->unit = "tokens";
+    return bench_loop(&bench_opts, r, [&]() -> size_t {
+        source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+
+        token_stream tokens;
+        token_stream_init(&tokens, ctx, code, source);
+        // Including the EOF token
+        size_t n = 1;
+        while (take_token(&tokens)->tok != TOKEN_EOF) {
+            n++;
+        }
+
+        remove_source(global_sources(), source);
+        return tokens.failed ? 0 : n;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "lexer", &bench_lexer);
+}
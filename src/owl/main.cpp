@@ -1,28 +1,188 @@
-#include "owl/compiler.hpp"
+#include "owl/driver.hpp"
+#include "owl/server.hpp"
+#include "owl/thread_pool.hpp"
+#include "owl/trace.hpp"
 
+#include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+static void print_usage()
+{
+    printf("Owl programming language compiler\n"
+           "Usage:\n"
+           "  owl [-j N] [--time-trace=FILE] [--model-cache=DIR] [--cache=DIR]\n"
+           "      [--emit-c=DIR [--layout-report]] [--connect=SOCKET] file...\n"
+           "  owl [-j N] [--model-cache=DIR] [--cache=DIR] --server=SOCKET\n"
+           "Options:\n"
+           "  -j N               compile with N threads, files and function bodies in parallel\n"
+           "  --time-trace=FILE  write Chrome trace of compilation phases to FILE\n"
+           "  --model-cache=DIR  keep parsed models in DIR, unchanged files are not parsed\n"
+           "                     again (and print no parser debug output)\n"
+           "  --cache=DIR        keep compilation results in DIR, output of unchanged files is\n"
+           "                     replayed without compiling them\n"
+           "  --emit-c=DIR       write C code of every file to DIR, named after the file\n"
+           "  --layout-report    print size, padding and cache lines of every emitted object\n"
+           "  --server=SOCKET    run as compile server listening on SOCKET, keeps results of\n"
+           "                     unchanged files in memory between requests\n"
+           "  --connect=SOCKET   compile on the server at SOCKET, or locally if there is none\n"
+           "File name '-' reads from stdin.\n");
+}
 
 int main(int argc, char **argv)
 {
-    if (argc == 1) {
-        printf("Owl programming language compiler\n"
-               "Usage:\n"
-               "  owl file...\n");
+    int n_threads = 1;
+    const char *trace_file = nullptr;
+    const char *model_cache_dir = nullptr;
+    const char *result_cache_dir = nullptr;
+    const char *server_socket = nullptr;
+    const char *connect_socket = nullptr;
+    const char *c_output_dir = nullptr;
+    bool layout_report = false;
+
+    enum {
+        OPT_TIME_TRACE = 256,
+        OPT_MODEL_CACHE,
+        OPT_CACHE,
+        OPT_SERVER,
+        OPT_CONNECT,
+        OPT_EMIT_C,
+        OPT_LAYOUT_REPORT,
+    };
+    static const option long_options[] = {
+            {"time-trace", required_argument, nullptr, OPT_TIME_TRACE},
+            {"model-cache", required_argument, nullptr, OPT_MODEL_CACHE},
+            {"cache", required_argument, nullptr, OPT_CACHE},
+            {"server", required_argument, nullptr, OPT_SERVER},
+            {"connect", required_argument, nullptr, OPT_CONNECT},
+            {"emit-c", required_argument, nullptr, OPT_EMIT_C},
+            {"layout-report", no_argument, nullptr, OPT_LAYOUT_REPORT},
+            {nullptr, 0, nullptr, 0},
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "j:", long_options, nullptr)) != -1) {
+        switch (opt) {
+        case 'j':
+            n_threads = atoi(optarg);
+            if (n_threads <= 0) {
+                fprintf(stderr, "Invalid number of jobs: '%s'\n", optarg);
+                return 1;
+            }
+            break;
+        case OPT_TIME_TRACE:
+            trace_file = optarg;
+            break;
+        case OPT_MODEL_CACHE:
+            model_cache_dir = optarg;
+            break;
+        case OPT_CACHE:
+            result_cache_dir = optarg;
+            break;
+        case OPT_SERVER:
+            server_socket = optarg;
+            break;
+        case OPT_CONNECT:
+            connect_socket = optarg;
+            break;
+        case OPT_EMIT_C:
+            c_output_dir = optarg;
+            break;
+        case OPT_LAYOUT_REPORT:
+            layout_report = true;
+            break;
+        default:
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (trace_file && (server_socket || connect_socket)) {
+        fprintf(stderr, "--time-trace cannot be used with --server or --connect\n");
+        return 1;
+    }
+    if (server_socket && c_output_dir) {
+        fprintf(stderr, "--emit-c is an option of the client, not of --server\n");
+        return 1;
+    }
+    if (layout_report && !c_output_dir) {
+        fprintf(stderr, "--layout-report needs --emit-c\n");
+        return 1;
+    }
+    if (server_socket && optind != argc) {
+        fprintf(stderr, "--server takes no files\n");
+        return 1;
+    }
+    if (!server_socket && optind == argc) {
+        print_usage();
         return 0;
     }
 
-    owl::context ctx;
-    // ctx.debug_lexer = true;
+    // Options shared by all files
+    owl::context options;
+    // options.debug_lexer = true;
 
-    for (int i = 1; i < argc; i++) {
-        const char *file_name = argv[i];
-        if (!owl::compile_file(&ctx, file_name)) {
-            fprintf(stderr, "Failed to compile '%s'\n", file_name);
+    if (model_cache_dir) {
+        options.model_cache_dir = model_cache_dir;
+    }
+    if (result_cache_dir) {
+        options.result_cache_dir = result_cache_dir;
+    }
+    if (c_output_dir) {
+        options.c_output_dir = c_output_dir;
+    }
+    options.layout_report = layout_report;
+
+    if (server_socket) {
+        return owl::run_server(server_socket, &options, n_threads);
+    }
+
+    std::vector<std::string> files(argv + optind, argv + argc);
+    // Server cannot read stdin of the client
+    bool reads_stdin = std::find(files.begin(), files.end(), "-") != files.end();
+    if (connect_socket && !reads_stdin) {
+        int rc = owl::run_client(connect_socket, &options, files);
+        if (rc >= 0) {
+            return rc;
         }
     }
 
-    if (ctx.n_errors == 0) {
+    std::unique_ptr<owl::tracer> trace;
+    if (trace_file) {
+        trace = std::make_unique<owl::tracer>();
+        options.trace = trace.get();
+    }
+
+    // Shared by files and by passes within a file
+    std::unique_ptr<owl::thread_pool> pool;
+    if (n_threads > 1) {
+        pool = std::make_unique<owl::thread_pool>(n_threads);
+        options.pool = pool.get();
+    }
+
+    int rc = 0;
+    if (!pool || files.size() == 1) {
+        rc = owl::compile_files(&options, files, nullptr, nullptr);
+    } else {
+        rc = owl::compile_files(&options, files, pool.get(), [](owl::compile_job *job) {
+            fwrite(job->debug_buf, 1, job->debug_size, stdout);
+            fflush(stdout);
+            fwrite(job->error_buf, 1, job->error_size, stderr);
+        });
+    }
+
+    if (trace && !owl::write_trace(trace.get(), trace_file)) {
+        fprintf(stderr, "Failed to write trace to '%s'\n", trace_file);
+    }
+
+    if (rc == 0) {
         fprintf(stdout, "Compilation successful\n");
     }
-    return ctx.n_errors > 0 ? 1 : 0;
+    return rc;
 }
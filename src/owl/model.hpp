@@ -1,12 +1,17 @@
 #ifndef OWL_MODEL_HPP
 #define OWL_MODEL_HPP
 
-#include <string>
+#include "owl/arena.hpp"
+#include "owl/context.hpp"
+#include "owl/symbols.hpp"
+
 #include <string_view>
 #include <vector>
 
 /**
- * Model nodes. Model is a graph representing parsed program.
+ * Model nodes. Model is a graph representing parsed program. All nodes and their child lists are
+ * allocated in the arena of the compilation and released together with it, nodes are never
+ * destroyed one by one.
  */
 
 namespace owl {
@@ -42,15 +47,9 @@ struct mod_unit;
  */
 struct mod_node {
     const mod_node_t type = MOD_NULL;
-
-    int lnum = 0;
-    int cnum = 0;
-    std::string_view text;
+    source_loc loc = NO_LOC;
 
     explicit mod_node(mod_node_t t): type{t} {}
-    virtual ~mod_node() = default;
-
-    virtual void destroy_rec() { delete this; }
 };
 
 /**
@@ -60,7 +59,6 @@ struct mod_expr: mod_node {
     mod_type *data_type = nullptr;
 
     explicit mod_expr(mod_node_t type): mod_node(type) {}
-    void destroy_rec() override;
 };
 
 /**
@@ -68,14 +66,17 @@ struct mod_expr: mod_node {
  */
 struct mod_stmt: mod_node {
     explicit mod_stmt(mod_node_t type): mod_node(type) {}
-    void destroy_rec() override;
 };
 
 /**
- * Type definition.
+ * Type definition, one per distinct type, see type_table.
  */
 struct type_definition {
-    std::string name;
+    symbol_id name = NO_SYMBOL;
+    // Index in the type table
+    uint32_t id = 0;
+    // Object or struct, null for builtin types
+    mod_node *def = nullptr;
 
     bool is_builtin = false;
     bool is_ref = false;
@@ -85,19 +86,18 @@ struct type_definition {
  * Function definition
  */
 struct mod_function: mod_node {
-    std::string name;
+    symbol_id name = NO_SYMBOL;
     mod_type *data_type = nullptr;
     mod_body *body = nullptr;
 
     mod_function(): mod_node(MOD_FUNCTION) {}
-    void destroy_rec() override;
 };
 
 /**
  * Variable/field definition
  */
 struct mod_variable: mod_node {
-    std::string name;
+    symbol_id name = NO_SYMBOL;
 
     mod_type *data_type = nullptr;
     mod_expr *init_expr = nullptr;
@@ -105,49 +105,51 @@ struct mod_variable: mod_node {
     bool auto_var = false;
 
     mod_variable(): mod_node(MOD_VARIABLE) {}
-    void destroy_rec() override;
 };
 
 /**
  * Object type definition
  */
 struct mod_object: mod_node {
-    std::string name;
-    std::vector<mod_variable *> fields;
+    symbol_id name = NO_SYMBOL;
+    arena_vector<mod_variable *> fields;
+
+    // Declared "extern": fields are laid out in declaration order, as C code expects them
+    bool c_layout = false;
+    // Declared "soa": arrays of the object are laid out as an array per field
+    bool soa = false;
 
-    mod_object(): mod_node(MOD_OBJECT) {}
-    void destroy_rec() override;
+    explicit mod_object(arena *a): mod_node(MOD_OBJECT), fields(arena_allocator<mod_variable *>(a))
+    {
+    }
 };
 
 /**
  * Struct type definition
  */
 struct mod_struct: mod_node {
-    std::string name;
+    symbol_id name = NO_SYMBOL;
 
     mod_struct(): mod_node(MOD_STRUCT) {}
-    void destroy_rec() override;
 };
 
 /**
  * Expression type, links to the type definition.
  */
 struct mod_type: mod_node {
-    std::string name;
+    symbol_id name = NO_SYMBOL;
     type_definition *type_def = nullptr;
 
     mod_type(): mod_node(MOD_TYPE) {}
-    void destroy_rec() override;
 };
 
 /**
  * Function body (list of statements)
  */
 struct mod_body: mod_node {
-    std::vector<mod_node *> statements;
+    arena_vector<mod_node *> statements;
 
-    mod_body(): mod_node(MOD_BODY) {}
-    void destroy_rec() override;
+    explicit mod_body(arena *a): mod_node(MOD_BODY), statements(arena_allocator<mod_node *>(a)) {}
 };
 
 /**
@@ -157,42 +159,48 @@ struct mod_stmt_return: mod_stmt {
     mod_expr *expr = nullptr;
 
     mod_stmt_return(): mod_stmt(MOD_STMT_RETURN) {}
-    void destroy_rec() override;
 };
 
 /**
  * Function application
  */
 struct mod_expr_apply: mod_expr {
-    std::string name;
-    std::vector<mod_variable *> args;
-
-    mod_expr_apply(): mod_expr(MOD_EXPR_APPLY) {}
-    void destroy_rec() override;
+    symbol_id name = NO_SYMBOL;
+    // Resolved by deduce_types
+    mod_function *function = nullptr;
+    arena_vector<mod_variable *> args;
+
+    explicit mod_expr_apply(arena *a):
+            mod_expr(MOD_EXPR_APPLY), args(arena_allocator<mod_variable *>(a))
+    {
+    }
 };
 
 /**
  * Value (literal) in expression
  */
 struct mod_expr_value: mod_expr {
-    std::string text;
+    symbol_id value = NO_SYMBOL;
 
     mod_expr_value(): mod_expr(MOD_EXPR_VALUE) {}
-    void destroy_rec() override;
 };
 
 struct mod_unit: mod_node {
-    std::vector<mod_function *> functions;
-    std::vector<mod_variable *> variables;
-    std::vector<mod_object *> objects;
-    std::vector<mod_struct *> structs;
-
-    mod_unit(): mod_node(MOD_UNIT) {}
-    void destroy_rec() override;
+    arena_vector<mod_function *> functions;
+    arena_vector<mod_variable *> variables;
+    arena_vector<mod_object *> objects;
+    arena_vector<mod_struct *> structs;
+
+    explicit mod_unit(arena *a):
+            mod_node(MOD_UNIT),
+            functions(arena_allocator<mod_function *>(a)),
+            variables(arena_allocator<mod_variable *>(a)),
+            objects(arena_allocator<mod_object *>(a)),
+            structs(arena_allocator<mod_struct *>(a))
+    {
+    }
 };
 
-void destroy_rec(mod_node *node);
-
 } // owl
 
 #endif
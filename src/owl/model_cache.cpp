@@ -0,0 +1,385 @@
+#include "owl/model_cache.hpp"
+
+#include "owl/symbols.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace owl {
+
+// "OWLM" read as little endian, also rejects files of the other byte order
+constexpr uint32_t MODEL_CACHE_MAGIC = 0x4d4c574f;
+
+// Sections are aligned for their element types
+constexpr size_t SECTION_ALIGN = 8;
+
+enum cache_section_t {
+    SECTION_SYMBOL_TEXT,
+    SECTION_SYMBOL_ENDS, // End offset of every symbol from id 1 in the text
+    SECTION_LINES,
+    SECTION_FUNCTIONS,
+    SECTION_VARIABLES,
+    SECTION_OBJECTS,
+    SECTION_STRUCTS,
+    SECTION_TYPES,
+    SECTION_BODIES,
+    SECTION_STMT_RETURNS,
+    SECTION_EXPR_APPLIES,
+    SECTION_EXPR_VALUES,
+    SECTION_CHILDREN,
+    SECTION_UNIT,
+    SECTION_CODE, // Source code, for incremental parsing of the next version
+    SECTION_DEFS,
+    SECTION_SIZE,
+};
+
+struct cache_section {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+};
+
+/**
+ * Cache file header, followed by the sections. Offsets are from the start of the file.
+ */
+struct cache_header {
+    uint32_t magic = MODEL_CACHE_MAGIC;
+    uint32_t version = MODEL_CACHE_VERSION;
+    uint64_t source_size = 0;
+    uint64_t source_hash = 0;
+    // Of all sections in order, detects damaged files
+    uint64_t data_hash = 0;
+    cache_section sections[SECTION_SIZE];
+};
+
+static uint64_t combine_hash(uint64_t h, uint64_t section_hash)
+{
+    return (h ^ section_hash) * 0x100000001b3ull;
+}
+
+// Files of the same name in different directories get different cache files
+std::string model_cache_path(context *ctx)
+{
+    char *abs_path = realpath(ctx->file_name.c_str(), nullptr);
+    const uint64_t h = hash_string(abs_path ? std::string_view(abs_path) : ctx->file_name);
+    free(abs_path);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.owlm", (unsigned long long) h);
+    return ctx->model_cache_dir + "/" + name;
+}
+
+static const cache_header *header_of(const model_mapping *map)
+{
+    return (const cache_header *) map->data;
+}
+
+static std::string_view section_data(const model_mapping *map, cache_section_t id)
+{
+    const cache_section &s = header_of(map)->sections[id];
+    return std::string_view(map->data + s.offset, s.size);
+}
+
+// Sections are in the file and not damaged
+static bool check_sections(const model_mapping *map)
+{
+    uint64_t h = 0;
+    for (int id = 0; id < SECTION_SIZE; id++) {
+        const cache_section &s = header_of(map)->sections[id];
+        if (s.offset > map->size || s.size > map->size - s.offset) {
+            return false;
+        }
+        h = combine_hash(h, hash_content(section_data(map, (cache_section_t) id)));
+    }
+    return h == header_of(map)->data_hash;
+}
+
+// Section is used in place, mapping is page aligned and sections are aligned for their elements
+template <typename T>
+static bool view_section(const model_mapping *map, cache_section_t id, flat_span<T> *array)
+{
+    const cache_section &s = header_of(map)->sections[id];
+    if (s.size % sizeof(T) != 0 || s.offset % alignof(T) != 0) {
+        return false;
+    }
+
+    *array = flat_span<T>((const T *) (map->data + s.offset), s.size / sizeof(T));
+    return true;
+}
+
+// Locations stay relative to the source: offset + 1
+static bool view_cached_model(const model_mapping *map, flat_view *m)
+{
+    flat_span<flat_unit> unit;
+    bool ok = view_section(map, SECTION_FUNCTIONS, &m->functions)
+            && view_section(map, SECTION_VARIABLES, &m->variables)
+            && view_section(map, SECTION_OBJECTS, &m->objects)
+            && view_section(map, SECTION_STRUCTS, &m->structs)
+            && view_section(map, SECTION_TYPES, &m->types)
+            && view_section(map, SECTION_BODIES, &m->bodies)
+            && view_section(map, SECTION_STMT_RETURNS, &m->stmt_returns)
+            && view_section(map, SECTION_EXPR_APPLIES, &m->expr_applies)
+            && view_section(map, SECTION_EXPR_VALUES, &m->expr_values)
+            && view_section(map, SECTION_CHILDREN, &m->children)
+            && view_section(map, SECTION_UNIT, &unit) && unit.size() == 1;
+    if (ok) {
+        m->unit = unit[0];
+    }
+    return ok;
+}
+
+// Symbols are interned in id order, so ids in the model stay valid
+static bool read_symbols(context *ctx, const model_mapping *map, flat_span<uint32_t> ends)
+{
+    std::string_view text = section_data(map, SECTION_SYMBOL_TEXT);
+
+    uint32_t start = 0;
+    for (size_t i = 0; i < ends.size(); i++) {
+        if (ends[i] < start || ends[i] > text.size()) {
+            return false;
+        }
+        if (intern(ctx->symbols, text.substr(start, ends[i] - start)) != i + 1) {
+            return false;
+        }
+        start = ends[i];
+    }
+    return true;
+}
+
+static bool read_lines(const model_mapping *map, source_entry *source)
+{
+    flat_span<uint32_t> starts;
+    if (!view_section(map, SECTION_LINES, &starts)) {
+        return false;
+    }
+
+    if (starts.size() == 0 || starts[0] != 0 || starts[starts.size() - 1] > source->size
+            || !std::is_sorted(starts.begin(), starts.end())) {
+        return false;
+    }
+
+    source->lines.starts.assign(starts.begin(), starts.end());
+    return true;
+}
+
+model_mapping::~model_mapping()
+{
+    if (data) {
+        munmap((void *) data, size);
+    }
+}
+
+bool map_model_cache(context *ctx, model_mapping *map)
+{
+    int fd = open(model_cache_path(ctx).c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st = {};
+    void *addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t) st.st_size >= sizeof(cache_header)) {
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+
+    map->data = (const char *) addr;
+    map->size = st.st_size;
+    const cache_header *h = header_of(map);
+    if (h->magic != MODEL_CACHE_MAGIC || h->version != MODEL_CACHE_VERSION
+            || !check_sections(map)) {
+        munmap(addr, st.st_size);
+        map->data = nullptr;
+        map->size = 0;
+        return false;
+    }
+    return true;
+}
+
+bool read_model_cache(context *ctx,
+        const model_mapping *map,
+        std::string_view code,
+        source_entry *source,
+        flat_view *m)
+{
+    if (!map->data) {
+        return false;
+    }
+
+    // Model and symbol ids are checked before anything is interned
+    flat_span<uint32_t> symbol_ends;
+    bool ok = header_of(map)->source_size == code.size()
+            && header_of(map)->source_hash == hash_content(code)
+            && view_section(map, SECTION_SYMBOL_ENDS, &symbol_ends)
+            && view_cached_model(map, m) && check_model(m, symbol_ends.size() + 1)
+            && read_lines(map, source) && read_symbols(ctx, map, symbol_ends);
+    if (!ok) {
+        *m = flat_view();
+        return false;
+    }
+
+    m->loc_delta = (int64_t) source->base - (NO_LOC + 1);
+    return true;
+}
+
+// Definitions are in code order, cover the unit lists in their order and are in the code
+static bool check_defs(flat_span<def_range> defs, const flat_view *m, size_t code_size)
+{
+    uint32_t n_functions = 0;
+    uint32_t n_variables = 0;
+    uint32_t n_objects = 0;
+    uint32_t end = 0;
+    for (const def_range &d : defs) {
+        uint32_t *n = nullptr;
+        switch (d.kind) {
+        case MOD_FUNCTION:
+            n = &n_functions;
+            break;
+        case MOD_VARIABLE:
+            n = &n_variables;
+            break;
+        case MOD_OBJECT:
+            n = &n_objects;
+            break;
+        default:
+            return false;
+        }
+        if (d.index != (*n)++ || d.start < end || d.end < d.start || d.end > code_size) {
+            return false;
+        }
+        end = d.end;
+    }
+
+    const flat_unit &u = m->unit;
+    return n_functions == u.functions.count && n_variables == u.variables.count
+            && n_objects == u.objects.count;
+}
+
+bool read_previous_model(context *ctx, const model_mapping *map, previous_model *p)
+{
+    if (!map->data) {
+        return false;
+    }
+
+    flat_span<uint32_t> symbol_ends;
+    p->code = section_data(map, SECTION_CODE);
+    bool ok = p->code.size() == header_of(map)->source_size
+            && view_section(map, SECTION_SYMBOL_ENDS, &symbol_ends)
+            && view_cached_model(map, &p->model)
+            && check_model(&p->model, symbol_ends.size() + 1)
+            && view_section(map, SECTION_DEFS, &p->defs)
+            && check_defs(p->defs, &p->model, p->code.size())
+            && read_symbols(ctx, map, symbol_ends);
+    if (!ok) {
+        *p = previous_model();
+    }
+    return ok;
+}
+
+struct cache_writer {
+    FILE *f = nullptr;
+    cache_header header;
+    uint64_t offset = sizeof(cache_header);
+    bool ok = true;
+};
+
+static void write_section(cache_writer *w, cache_section_t id, const void *data, size_t size)
+{
+    static const char zeros[SECTION_ALIGN] = {};
+    size_t pad = (SECTION_ALIGN - w->offset % SECTION_ALIGN) % SECTION_ALIGN;
+    w->ok = w->ok && fwrite(zeros, 1, pad, w->f) == pad;
+    w->offset += pad;
+
+    w->header.sections[id].offset = w->offset;
+    w->header.sections[id].size = size;
+    w->header.data_hash = combine_hash(
+            w->header.data_hash, hash_content(std::string_view((const char *) data, size)));
+    w->ok = w->ok && fwrite(data, 1, size, w->f) == size;
+    w->offset += size;
+}
+
+template <typename T>
+static void write_section(cache_writer *w, cache_section_t id, const std::vector<T> &array)
+{
+    write_section(w, id, array.data(), array.size() * sizeof(T));
+}
+
+// Written to a temporary file and renamed, so readers never see a partial file
+bool write_model_cache(context *ctx,
+        std::string_view code,
+        const source_entry *source,
+        const std::vector<def_range> &defs,
+        flat_model *m)
+{
+    std::string path = model_cache_path(ctx);
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkstemp(tmp_path.data());
+    if (fd < 0) {
+        return false;
+    }
+
+    cache_writer w;
+    w.f = fdopen(fd, "wb");
+    if (!w.f) {
+        close(fd);
+        unlink(tmp_path.c_str());
+        return false;
+    }
+
+    w.header.source_size = code.size();
+    w.header.source_hash = hash_content(code);
+
+    // Header is rewritten once section offsets are known
+    w.ok = fwrite(&w.header, sizeof(w.header), 1, w.f) == 1;
+
+    // Symbol table may hold symbols of code that is gone, such as definitions of the previous model
+    // that were parsed again, only those of the model are written
+    const auto &entries = ctx->symbols->entries;
+    std::vector<symbol_id> symbols = compact_symbols(m, entries.size());
+    std::string symbol_text;
+    std::vector<uint32_t> symbol_ends;
+    for (size_t i = 1; i < symbols.size(); i++) {
+        symbol_text += entries[symbols[i]].name;
+        symbol_ends.push_back(symbol_text.size());
+    }
+
+    rebase_model(m, source->base, NO_LOC + 1);
+
+    // In section order, data hash depends on it
+    write_section(&w, SECTION_SYMBOL_TEXT, symbol_text.data(), symbol_text.size());
+    write_section(&w, SECTION_SYMBOL_ENDS, symbol_ends);
+    write_section(&w, SECTION_LINES, source->lines.starts);
+    write_section(&w, SECTION_FUNCTIONS, m->functions);
+    write_section(&w, SECTION_VARIABLES, m->variables);
+    write_section(&w, SECTION_OBJECTS, m->objects);
+    write_section(&w, SECTION_STRUCTS, m->structs);
+    write_section(&w, SECTION_TYPES, m->types);
+    write_section(&w, SECTION_BODIES, m->bodies);
+    write_section(&w, SECTION_STMT_RETURNS, m->stmt_returns);
+    write_section(&w, SECTION_EXPR_APPLIES, m->expr_applies);
+    write_section(&w, SECTION_EXPR_VALUES, m->expr_values);
+    write_section(&w, SECTION_CHILDREN, m->children);
+    write_section(&w, SECTION_UNIT, &m->unit, sizeof(m->unit));
+    write_section(&w, SECTION_CODE, code.data(), code.size());
+    write_section(&w, SECTION_DEFS, defs);
+
+    w.ok = w.ok && fseek(w.f, 0, SEEK_SET) == 0
+            && fwrite(&w.header, sizeof(w.header), 1, w.f) == 1;
+    w.ok = fclose(w.f) == 0 && w.ok;
+
+    if (!w.ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // owl
@@ -0,0 +1,82 @@
+#ifndef OWL_MODEL_CACHE_HPP
+#define OWL_MODEL_CACHE_HPP
+
+#include "owl/context.hpp"
+#include "owl/flat_model.hpp"
+#include "owl/parser.hpp"
+#include "owl/source.hpp"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Model cache. Parsed model of a file is saved as its flat model, together with the symbols it uses
+ * and the line index of the source, in a file of the cache directory. Next compilation of the same
+ * code maps the file and reads the model in place instead of lexing and parsing. Cache file is
+ * tied to the source by its size and content hash; locations are stored relative to the source.
+ * The file also keeps the code and its definition ranges, so a changed version of the file can
+ * be parsed incrementally against it.
+ * Failures to read or write the cache are not errors, the file is parsed as usual.
+ */
+
+namespace owl {
+
+// Bumped on every change of the file layout or of flat model nodes
+constexpr uint32_t MODEL_CACHE_VERSION = 4;
+
+// Cache file of the file of the context, named by the hash of its absolute path
+std::string model_cache_path(context *ctx);
+
+/**
+ * Cache file mapped into memory. Models are read from it in place, the mapping must stay alive as
+ * long as they are used.
+ */
+struct model_mapping {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    model_mapping() = default;
+    model_mapping(const model_mapping &) = delete;
+    model_mapping &operator=(const model_mapping &) = delete;
+    ~model_mapping();
+};
+
+// Maps the cache file of the file of the context, returns false if it is missing or damaged
+bool map_model_cache(context *ctx, model_mapping *map);
+
+// Fills the model, the symbol table (must be empty) and the line index of the source, if the cache
+// is of the code. Model locations are moved to the source.
+bool read_model_cache(context *ctx,
+        const model_mapping *map,
+        std::string_view code,
+        source_entry *source,
+        flat_view *m);
+
+/**
+ * Cached model of whatever version of the file was compiled last, in the mapping. Locations are
+ * relative to the code: offset + 1.
+ */
+struct previous_model {
+    std::string_view code;
+    flat_view model;
+    flat_span<def_range> defs;
+};
+
+// Fills the model and the symbol table (must be empty), regardless of the current code
+bool read_previous_model(context *ctx, const model_mapping *map, previous_model *p);
+
+// Model locations must be in the source, they are made relative to it and its symbols are
+// renumbered in place
+bool write_model_cache(context *ctx,
+        std::string_view code,
+        const source_entry *source,
+        const std::vector<def_range> &defs,
+        flat_model *m);
+
+} // owl
+
+#endif
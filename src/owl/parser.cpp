@@ -1,43 +1,76 @@
 #include "owl/parser.hpp"
 
-#include <iostream>
+#include "owl/trace.hpp"
+
+#include <assert.h>
+#include <stdarg.h>
 
 namespace owl {
 
 struct parse_ctx {
     context *parent_ctx = nullptr;
+    arena *node_arena = nullptr;
 
-    const token *p_tokens = nullptr;
-    size_t n_tokens = 0;
+    token_stream *tokens = nullptr;
+    uint32_t last_end = 0; // End of the last token taken
 
-    size_t curr = 0;
+    std::vector<def_range> *defs = nullptr;
 };
 
-static void set_node(mod_node *node, const token *t)
+static std::string_view text_of(parse_ctx *ctx, const token *t)
 {
-    node->lnum = t->lnum;
-    node->cnum = t->cnum;
-    node->text = t->text;
+    return token_text(&ctx->tokens->lex, t);
 }
 
-static const token *peek_token(parse_ctx *ctx)
+static source_loc loc_of(parse_ctx *ctx, const token *t)
 {
-    return &ctx->p_tokens[ctx->curr];
+    return ctx->tokens->lex.source->base + t->offset;
 }
 
-static const token *take_token(parse_ctx *ctx)
+static void set_node(parse_ctx *ctx, mod_node *node, const token *t)
 {
-    return &ctx->p_tokens[ctx->curr++];
+    node->loc = loc_of(ctx, t);
+}
+
+static void print_name(parse_ctx *ctx, const char *entity, symbol_id name)
+{
+    if (!ctx->parent_ctx->f_debug) {
+        return;
+    }
+    auto text = symbol_name(ctx->parent_ctx->symbols, name);
+    fprintf(ctx->parent_ctx->f_debug, "%s: %.*s\n", entity, (int) text.size(), text.data());
 }
 
-static bool is_word(const token *t, const char *word)
+// Report error at token. If lexer failed, the parser sees a premature EOF; lexer has reported the
+// actual error already, so errors that follow are not reported.
+static void parse_error(parse_ctx *ctx, const token *t, const char *format, ...)
+{
+    if (ctx->tokens->failed) {
+        return;
+    }
+
+    va_list va;
+    va_start(va, format);
+    compiler_error_va(ctx->parent_ctx, loc_of(ctx, t), format, va);
+    va_end(va);
+}
+
+static const token *peek_token(parse_ctx *ctx)
 {
-    return t->tok == TOKEN_WORD && t->text == word;
+    return peek_token(ctx->tokens, 0);
 }
 
+static const token *take_token(parse_ctx *ctx)
+{
+    const token *t = take_token(ctx->tokens);
+    ctx->last_end = t->offset + t->size;
+    return t;
+}
+
+// Keywords have token kinds of their own, so any word is an identifier
 static bool is_identifier(const token *t)
 {
-    return t->tok == TOKEN_WORD && !is_keyword(t->text);
+    return t->tok == TOKEN_WORD;
 }
 
 static mod_type *parse_type(parse_ctx *ctx)
@@ -45,17 +78,13 @@ static mod_type *parse_type(parse_ctx *ctx)
     const token *t = nullptr;
 
     if (!is_identifier(t = take_token(ctx))) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "data type: type name expected, found %s",
-                token_name(t->tok));
+        parse_error(ctx, t, "data type: type name expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_type();
-    set_node(e, t);
-    e->name = std::string(t->text);
+    auto *e = arena_new<mod_type>(ctx->node_arena);
+    set_node(ctx, e, t);
+    e->name = intern(ctx->parent_ctx->symbols, text_of(ctx, t));
 
     return e;
 }
@@ -65,14 +94,13 @@ static mod_expr *parse_expr(parse_ctx *ctx)
     const token *t = nullptr;
 
     if ((t = take_token(ctx))->tok != TOKEN_NUMBER) {
-        compiler_error_at(
-                ctx->parent_ctx, t->lnum, t->cnum, "invalid expression", token_name(t->tok));
+        parse_error(ctx, t, "invalid expression", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_expr_value();
-    set_node(e, t);
-    e->text = std::string(t->text);
+    auto *e = arena_new<mod_expr_value>(ctx->node_arena);
+    set_node(ctx, e, t);
+    e->value = intern(ctx->parent_ctx->symbols, text_of(ctx, t));
 
     return e;
 }
@@ -81,21 +109,16 @@ static mod_stmt_return *parse_return(parse_ctx *ctx)
 {
     const token *t = take_token(ctx);
 
-    if (!is_word(t, KW_RETURN)) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "return statement expected, found %s",
-                token_name(t->tok));
+    if (t->tok != TOKEN_KW_RETURN) {
+        parse_error(ctx, t, "return statement expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_stmt_return();
-    set_node(e, t);
+    auto *e = arena_new<mod_stmt_return>(ctx->node_arena);
+    set_node(ctx, e, t);
 
     e->expr = parse_expr(ctx);
     if (!e->expr) {
-        destroy_rec(e);
         return nullptr;
     }
 
@@ -105,31 +128,25 @@ static mod_stmt_return *parse_return(parse_ctx *ctx)
 static mod_body *parse_body(parse_ctx *ctx, const char *parent_entity)
 {
     const token *t = nullptr;
-    auto *e = new mod_body();
+    auto *e = arena_new<mod_body>(ctx->node_arena, ctx->node_arena);
 
     if ((t = take_token(ctx))->tok != TOKEN_LCURLY) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "%s: expected '{', found %s",
-                parent_entity,
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "%s: expected '{', found %s", parent_entity, token_name(t->tok));
         return nullptr;
     }
 
-    while ((t = peek_token(ctx))->tok != TOKEN_RCURLY) {
+    while ((t = peek_token(ctx))->tok != TOKEN_RCURLY && t->tok != TOKEN_EOF) {
+        // Statement parser consumes tokens, keep a copy for diagnostics
+        const token first = *t;
         mod_node *stmt = nullptr;
         bool recognized = false;
-        if (t->tok == TOKEN_WORD) {
-            switch (t->text[0]) {
-            case 'r':
-                if (t->text == KW_RETURN) {
-                    stmt = parse_return(ctx);
-                    recognized = true;
-                }
-                break;
-            }
+        switch (t->tok) {
+        case TOKEN_KW_RETURN:
+            stmt = parse_return(ctx);
+            recognized = true;
+            break;
+        default:
+            break;
         }
 
         if (!recognized) {
@@ -138,27 +155,19 @@ static mod_body *parse_body(parse_ctx *ctx, const char *parent_entity)
         }
 
         if (!stmt) {
-            compiler_error_at(ctx->parent_ctx,
-                    t->lnum,
-                    t->cnum,
+            parse_error(ctx,
+                    &first,
                     "%s: statement expected, found %s",
                     parent_entity,
-                    token_name(t->tok));
-            destroy_rec(e);
+                    token_name(first.tok));
             return nullptr;
         }
 
-        e->statements.push_back(e);
+        e->statements.push_back(stmt);
     }
 
     if ((t = take_token(ctx))->tok != TOKEN_RCURLY) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "%s: expected '}', found %s",
-                parent_entity,
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "%s: expected '}', found %s", parent_entity, token_name(t->tok));
         return nullptr;
     }
 
@@ -169,62 +178,46 @@ static mod_function *parse_function(parse_ctx *ctx)
 {
     const token *t = nullptr;
 
-    if (!is_word(t = take_token(ctx), KW_FUNC)) {
-        compiler_error_at(ctx->parent_ctx, t->lnum, t->cnum, "function expected");
+    if ((t = take_token(ctx))->tok != TOKEN_KW_FUNC) {
+        parse_error(ctx, t, "function expected");
         return nullptr;
     }
 
     if (!is_identifier(t = take_token(ctx))) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "function name expected, found %s",
-                token_name(t->tok));
+        parse_error(ctx, t, "function name expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_function();
-    set_node(e, t);
-    e->name = std::string(t->text);
+    auto *e = arena_new<mod_function>(ctx->node_arena);
+    set_node(ctx, e, t);
+    e->name = intern(ctx->parent_ctx->symbols, text_of(ctx, t));
 
     if ((t = take_token(ctx))->tok != TOKEN_LPAREN) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "function argument list: expected '(', found %s",
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "function argument list: expected '(', found %s", token_name(t->tok));
         return nullptr;
     }
 
     // Arguments
 
     if ((t = take_token(ctx))->tok != TOKEN_RPAREN) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "function argument list: expected ')', found %s",
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "function argument list: expected ')', found %s", token_name(t->tok));
         return nullptr;
     }
 
     if ((t = peek_token(ctx))->tok == TOKEN_COLON) {
-        ctx->curr++;
+        take_token(ctx);
         e->data_type = parse_type(ctx);
         if (!e->data_type) {
-            destroy_rec(e);
             return nullptr;
         }
     }
 
     e->body = parse_body(ctx, "function");
     if (!e->body) {
-        destroy_rec(e);
         return nullptr;
     }
 
-    std::cout << "function: " << e->name << "\n";
+    print_name(ctx, "function", e->name);
     return e;
 }
 
@@ -233,203 +226,220 @@ static mod_variable *parse_variable(parse_ctx *ctx)
     const token *t = nullptr;
 
     bool auto_var = false;
-    if (is_word(t = peek_token(ctx), KW_AUTO)) {
+    if ((t = peek_token(ctx))->tok == TOKEN_KW_AUTO) {
         auto_var = true;
-        ctx->curr++;
+        take_token(ctx);
     }
 
-    if (!is_word(t = take_token(ctx), KW_VAR)) {
-        compiler_error_at(ctx->parent_ctx, t->lnum, t->cnum, "variable expected");
+    if ((t = take_token(ctx))->tok != TOKEN_KW_VAR) {
+        parse_error(ctx, t, "variable expected");
         return nullptr;
     }
 
     if ((t = take_token(ctx))->tok != TOKEN_WORD) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "variable name expected, found %s",
-                token_name(t->tok));
+        parse_error(ctx, t, "variable name expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_variable();
-    set_node(e, t);
-    e->name = std::string(t->text);
+    auto *e = arena_new<mod_variable>(ctx->node_arena);
+    set_node(ctx, e, t);
+    e->name = intern(ctx->parent_ctx->symbols, text_of(ctx, t));
     e->auto_var = auto_var;
 
     // Optional type
     if ((t = peek_token(ctx))->tok == TOKEN_COLON) {
-        ctx->curr++;
+        take_token(ctx);
         e->data_type = parse_type(ctx);
         if (!e->data_type) {
-            destroy_rec(e);
             return nullptr;
         }
     }
 
     // Optional initializer
     if ((t = peek_token(ctx))->tok == TOKEN_EQ) {
-        ctx->curr++;
+        take_token(ctx);
         e->init_expr = parse_expr(ctx);
         if (!e->init_expr) {
-            destroy_rec(e);
             return nullptr;
         }
     }
 
     if ((t = take_token(ctx))->tok != TOKEN_SEMICOLON) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "variable: ';' expected, found %s",
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "variable: ';' expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    std::cout << "variable: " << e->name << "\n";
+    print_name(ctx, "variable", e->name);
     return e;
 }
 
+// "extern" and "soa", in any order
+static bool is_object_modifier(const token *t)
+{
+    return t->tok == TOKEN_KW_EXTERN || t->tok == TOKEN_KW_SOA;
+}
+
 static mod_object *parse_object_def(parse_ctx *ctx)
 {
     const token *t = nullptr;
 
-    if (!is_word(t = take_token(ctx), KW_OBJECT)) {
-        compiler_error_at(ctx->parent_ctx, t->lnum, t->cnum, "object def expected");
+    bool c_layout = false;
+    bool soa = false;
+    while (is_object_modifier(t = peek_token(ctx))) {
+        c_layout = c_layout || t->tok == TOKEN_KW_EXTERN;
+        soa = soa || t->tok == TOKEN_KW_SOA;
+        take_token(ctx);
+    }
+
+    if ((t = take_token(ctx))->tok != TOKEN_KW_OBJECT) {
+        parse_error(ctx, t, "object def expected");
         return nullptr;
     }
 
     if ((t = take_token(ctx))->tok != TOKEN_WORD) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "type name expected, found %s",
-                token_name(t->tok));
+        parse_error(ctx, t, "type name expected, found %s", token_name(t->tok));
         return nullptr;
     }
 
-    auto *e = new mod_object();
-    set_node(e, t);
-    e->name = std::string(t->text);
+    auto *e = arena_new<mod_object>(ctx->node_arena, ctx->node_arena);
+    set_node(ctx, e, t);
+    e->name = intern(ctx->parent_ctx->symbols, text_of(ctx, t));
+    e->c_layout = c_layout;
+    e->soa = soa;
 
     if ((t = take_token(ctx))->tok != TOKEN_LCURLY) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "object: expected '{', found %s",
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "object: expected '{', found %s", token_name(t->tok));
         return nullptr;
     }
 
     while (peek_token(ctx)->tok != TOKEN_RCURLY) {
         auto *f = parse_variable(ctx);
         if (!f) {
-            destroy_rec(e);
             return nullptr;
         }
         e->fields.push_back(f);
     }
 
     if ((t = take_token(ctx))->tok != TOKEN_RCURLY) {
-        compiler_error_at(ctx->parent_ctx,
-                t->lnum,
-                t->cnum,
-                "object: expected '}', found %s",
-                token_name(t->tok));
-        destroy_rec(e);
+        parse_error(ctx, t, "object: expected '}', found %s", token_name(t->tok));
         return nullptr;
     }
 
-    std::cout << "object: " << e->name << "\n";
+    print_name(ctx, "object", e->name);
     return e;
 }
 
+static void add_def(parse_ctx *ctx, mod_node_t kind, size_t index, uint32_t start)
+{
+    if (!ctx->defs) {
+        return;
+    }
+
+    def_range d;
+    d.kind = kind;
+    d.index = index;
+    d.start = start;
+    d.end = ctx->last_end;
+    ctx->defs->push_back(d);
+}
+
 static bool parse_top_level_def(parse_ctx *ctx, mod_unit *unit)
 {
+    trace_scope ts(ctx->parent_ctx, "parse_def");
     const token *t = peek_token(ctx);
-
-    // Look ahead
-    int adv = 0;
-    if (is_word(t, KW_AUTO)) {
-        t = &ctx->p_tokens[ctx->curr + 1];
-        adv++;
+    const uint32_t start = t->offset;
+
+    // Look ahead past "auto" and object modifiers, definition parsers consume them themselves. The
+    // window limits the lookahead, longer runs of modifiers are not recognized.
+    for (size_t ahead = 1;
+            ahead < TOKEN_WINDOW && (t->tok == TOKEN_KW_AUTO || is_object_modifier(t));
+            ahead++) {
+        t = peek_token(ctx->tokens, ahead);
     }
 
-    if (t->tok == TOKEN_EOF) {
-        return adv == 0;
+    switch (t->tok) {
+    case TOKEN_KW_FUNC: {
+        auto *e = parse_function(ctx);
+        if (e) {
+            ts.detail = symbol_name(ctx->parent_ctx->symbols, e->name);
+            add_def(ctx, MOD_FUNCTION, unit->functions.size(), start);
+            unit->functions.push_back(e);
+        }
+        return e != nullptr;
     }
 
-    // Step back where we stared after we found expected keyword position
-    ctx->curr -= adv;
-
-    switch (t->text[0]) {
-    case KW_FUNC[0]:
-        if (t->text == KW_FUNC) {
-            auto *e = parse_function(ctx);
-            if (e) {
-                unit->functions.push_back(e);
-            }
-            return e != nullptr;
+    case TOKEN_KW_VAR: {
+        auto *e = parse_variable(ctx);
+        if (e) {
+            ts.detail = symbol_name(ctx->parent_ctx->symbols, e->name);
+            add_def(ctx, MOD_VARIABLE, unit->variables.size(), start);
+            unit->variables.push_back(e);
         }
-        break;
+        return e != nullptr;
+    }
 
-    case KW_VAR[0]:
-        if (t->text == KW_VAR) {
-            auto *e = parse_variable(ctx);
-            if (e) {
-                unit->variables.push_back(e);
-            }
-            return e != nullptr;
+    case TOKEN_KW_OBJECT: {
+        auto *e = parse_object_def(ctx);
+        if (e) {
+            ts.detail = symbol_name(ctx->parent_ctx->symbols, e->name);
+            add_def(ctx, MOD_OBJECT, unit->objects.size(), start);
+            unit->objects.push_back(e);
         }
-        break;
+        return e != nullptr;
+    }
 
-    case KW_OBJECT[0]:
-        if (t->text == KW_OBJECT) {
-            auto *e = parse_object_def(ctx);
-            if (e) {
-                unit->objects.push_back(e);
-            }
-            return e != nullptr;
-        }
+    default:
         break;
     }
 
-    compiler_error_at(ctx->parent_ctx,
-            t->lnum,
-            t->cnum,
-            "unrecognized top level construct starting with %s",
-            token_name(t->tok));
+    parse_error(ctx, t, "unrecognized top level construct starting with %s", token_name(t->tok));
     return false;
 }
 
 static mod_unit *parse_unit(parse_ctx *ctx)
 {
-    auto *e = new mod_unit();
-
-    const token *t = peek_token(ctx);
-    while (t->tok != TOKEN_EOF && parse_top_level_def(ctx, e)) {
-        t = peek_token(ctx);
-    }
+    auto *e = arena_new<mod_unit>(ctx->node_arena, ctx->node_arena);
 
-    if (t->tok != TOKEN_EOF) {
-        destroy_rec(e);
-        return nullptr;
+    while (peek_token(ctx)->tok != TOKEN_EOF) {
+        if (!parse_top_level_def(ctx, e)) {
+            return nullptr;
+        }
     }
 
     return e;
 }
 
-mod_unit *parse(context *ctx, const token *p_tokens, size_t n_tokens)
+mod_unit *parse(context *ctx, arena *node_arena, token_stream *tokens, std::vector<def_range> *defs)
 {
     parse_ctx parse_ctx = {};
     parse_ctx.parent_ctx = ctx;
-    parse_ctx.p_tokens = p_tokens;
-    parse_ctx.n_tokens = n_tokens;
-    parse_ctx.curr = 0;
+    parse_ctx.node_arena = node_arena;
+    parse_ctx.tokens = tokens;
+    parse_ctx.defs = defs;
 
     return parse_unit(&parse_ctx);
 }
 
+bool parse_defs(context *ctx,
+        arena *node_arena,
+        token_stream *tokens,
+        uint32_t stop,
+        mod_unit *unit,
+        std::vector<def_range> *defs)
+{
+    parse_ctx parse_ctx = {};
+    parse_ctx.parent_ctx = ctx;
+    parse_ctx.node_arena = node_arena;
+    parse_ctx.tokens = tokens;
+    parse_ctx.defs = defs;
+
+    const token *t = nullptr;
+    while ((t = peek_token(&parse_ctx))->tok != TOKEN_EOF && t->offset < stop) {
+        if (!parse_top_level_def(&parse_ctx, unit)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 } // owl
@@ -1,16 +1,44 @@
 #ifndef OWL_PARSER_HPP
 #define OWL_PARSER_HPP
 
+#include "owl/arena.hpp"
 #include "owl/lexer.hpp"
 #include "owl/model.hpp"
 
+#include <stdint.h>
+
+#include <vector>
+
 /**
- * Parser. Build parse tree (model) from a stream of tokens.
+ * Parser. Build parse tree (model) from a stream of tokens. Nodes are allocated in `node_arena`.
  */
 
 namespace owl {
 
-mod_unit *parse(context *ctx, const token *p_tokens, size_t n_tokens);
+/**
+ * Code range of a top level definition, from the start of its first token to the end of its last
+ * one. Definitions are listed in code order.
+ */
+struct def_range {
+    uint32_t kind = MOD_NULL; // mod_node_t
+    uint32_t index = 0; // In the unit list of the kind
+    uint32_t start = 0;
+    uint32_t end = 0;
+};
+
+// Ranges of the definitions are added to defs, if set
+mod_unit *parse(context *ctx,
+        arena *node_arena,
+        token_stream *tokens,
+        std::vector<def_range> *defs = nullptr);
+
+// Parse definitions into the unit until EOF or a token at or after offset stop
+bool parse_defs(context *ctx,
+        arena *node_arena,
+        token_stream *tokens,
+        uint32_t stop,
+        mod_unit *unit,
+        std::vector<def_range> *defs);
 
 } // owl
 
@@ -0,0 +1,33 @@
+#include "owl/arena.hpp"
+#include "owl/bench.hpp"
+#include "owl/lexer.hpp"
+#include "owl/parser.hpp"
+#include "owl/symbols.hpp"
+
+using namespace owl;
+
+// Parser drives the lexer, so this is the cost of both stages
+static bool bench_parser(context *ctx, std::string_view code, bench_result *r)
+{
+    r->unit = "nodes";
+    return bench_loop(&bench_opts, r, [&]() -> size_t {
+        source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+        arena node_arena;
+        symbol_table symbols;
+        ctx->symbols = &symbols;
+
+        token_stream tokens;
+        token_stream_init(&tokens, ctx, code, source);
+        mod_unit *unit = parse(ctx, &node_arena, &tokens);
+        size_t n = unit && !tokens.failed ? count_nodes(ctx, unit) : 0;
+
+        remove_source(global_sources(), source);
+        ctx->symbols = nullptr;
+        return n;
+    });
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "parser", &bench_parser);
+}
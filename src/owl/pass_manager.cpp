@@ -0,0 +1,106 @@
+#include "owl/pass_manager.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+namespace owl {
+
+walk_output::~walk_output()
+{
+    free(debug_buf);
+    free(error_buf);
+}
+
+void begin_output(walk_output *out, const context *ctx)
+{
+    out->ctx = *ctx;
+    out->ctx.n_errors = 0;
+
+    FILE *f_debug = ctx->f_debug ? open_memstream(&out->debug_buf, &out->debug_size) : nullptr;
+    FILE *f_error = open_memstream(&out->error_buf, &out->error_size);
+    if ((ctx->f_debug && !f_debug) || !f_error) {
+        // Output is printed as it comes, out of order
+        if (f_debug) {
+            fclose(f_debug);
+        }
+        if (f_error) {
+            fclose(f_error);
+        }
+        return;
+    }
+    out->ctx.f_debug = f_debug;
+    out->ctx.f_error = f_error;
+    out->captured = true;
+}
+
+// Uncaptured output has marks at 0, so bodies are still counted
+void mark_output(walk_output *out)
+{
+    const bool captured = out->captured;
+    out->debug_marks.push_back(captured && out->ctx.f_debug ? ftell(out->ctx.f_debug) : 0);
+    out->error_marks.push_back(captured ? ftell(out->ctx.f_error) : 0);
+}
+
+void end_output(walk_output *out)
+{
+    if (!out->captured) {
+        return;
+    }
+    if (out->ctx.f_debug) {
+        fclose(out->ctx.f_debug);
+    }
+    fclose(out->ctx.f_error);
+}
+
+// One stream of a walk output
+struct output_view {
+    const char *data = nullptr;
+    size_t size = 0;
+    const std::vector<size_t> *marks = nullptr;
+};
+
+static void print_stream(FILE *f, const output_view &walk, const std::vector<output_view> &parts)
+{
+    size_t walk_pos = 0;
+    size_t body = 0;
+    for (const output_view &part : parts) {
+        size_t part_pos = 0;
+        for (size_t end : *part.marks) {
+            size_t walk_end = body < walk.marks->size() ? (*walk.marks)[body] : walk_pos;
+            fwrite(walk.data + walk_pos, 1, walk_end - walk_pos, f);
+            fwrite(part.data + part_pos, 1, end - part_pos, f);
+            walk_pos = walk_end;
+            part_pos = end;
+            body++;
+        }
+    }
+    fwrite(walk.data + walk_pos, 1, walk.size - walk_pos, f);
+}
+
+void print_walk_output(context *ctx,
+        const walk_output *walk,
+        const std::vector<std::unique_ptr<walk_output>> &parts)
+{
+    std::vector<output_view> debug_parts;
+    std::vector<output_view> error_parts;
+    for (const auto &part : parts) {
+        debug_parts.push_back({part->debug_buf, part->debug_size, &part->debug_marks});
+        error_parts.push_back({part->error_buf, part->error_size, &part->error_marks});
+    }
+
+    if (ctx->f_debug) {
+        print_stream(ctx->f_debug,
+                {walk->debug_buf, walk->debug_size, &walk->debug_marks},
+                debug_parts);
+    }
+    print_stream(ctx->f_error,
+            {walk->error_buf, walk->error_size, &walk->error_marks},
+            error_parts);
+
+    ctx->n_errors += walk->ctx.n_errors;
+    for (const auto &part : parts) {
+        ctx->n_errors += part->ctx.n_errors;
+    }
+}
+
+} // owl
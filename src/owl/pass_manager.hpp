@@ -0,0 +1,389 @@
+#ifndef OWL_PASS_MANAGER_HPP
+#define OWL_PASS_MANAGER_HPP
+
+#include "owl/context.hpp"
+#include "owl/model.hpp"
+#include "owl/thread_pool.hpp"
+#include "owl/trace.hpp"
+#include "owl/visitor.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Pass manager. Passes over the model declare node kinds they read and write, and handle nodes in
+ * pre-order (pre) and post-order (post). run_passes() fuses consecutive independent passes into a
+ * group that walks the unit once, every node is handled by all passes of the group while it is in
+ * cache. Dependent pass starts a new group, which walks the unit again after the previous group is
+ * done.
+ *
+ * If all passes of a group handle function bodies independently and the context has a thread
+ * pool, the group walks in two phases: first everything but function bodies, in order, then the
+ * bodies in parallel, in chunks. Every chunk is walked by instances of the passes of its own,
+ * with its output captured; output of all walks is printed in the order of a sequential walk.
+ */
+
+namespace owl {
+
+constexpr uint32_t mod_kind(mod_node_t t)
+{
+    return 1u << t;
+}
+
+/**
+ * Base of every pass. Pass defines pre(mod_xxx *) and post(mod_xxx *) overloads for the node kinds
+ * it handles; handler taking mod_node * gets all nodes.
+ */
+struct model_pass {
+    static constexpr const char *name = "pass";
+    // Node kinds (mod_kind bits) the pass reads results of other passes from, and writes to
+    static constexpr uint32_t reads = 0;
+    static constexpr uint32_t writes = 0;
+
+    // Function bodies are handled independently of each other and no handler outside a body
+    // depends on the body, so bodies may be walked later and in parallel
+    static constexpr bool independent_bodies = false;
+
+    context *root_ctx = nullptr;
+
+    explicit model_pass(context *ctx): root_ctx{ctx} {}
+
+    // Called on the passes of every parallel part of a walk with the passes of the walk, once that
+    // is done
+    template <typename P>
+    void begin_part(const P &walk)
+    {
+    }
+
+    // Result of the pass once the walk is done
+    bool finish() { return true; }
+};
+
+template <typename P, typename T, typename = void>
+struct has_pre: std::false_type {};
+
+template <typename P, typename T>
+struct has_pre<P, T, std::void_t<decltype(std::declval<P &>().pre((T *) nullptr))>>:
+        std::true_type {};
+
+template <typename P, typename T, typename = void>
+struct has_post: std::false_type {};
+
+template <typename P, typename T>
+struct has_post<P, T, std::void_t<decltype(std::declval<P &>().post((T *) nullptr))>>:
+        std::true_type {};
+
+// Later pass depends on the earlier one if it touches node kinds the earlier one writes, or writes
+// node kinds the earlier one reads. Kinds are tracked as a whole, because a pass reading a kind
+// may look at nodes the walk has not reached yet.
+constexpr bool passes_conflict(uint32_t reads1, uint32_t writes1, uint32_t reads2, uint32_t writes2)
+{
+    return (writes1 & (reads2 | writes2)) != 0 || (reads1 & writes2) != 0;
+}
+
+// Number of leading passes that can share a walk
+template <typename... P>
+constexpr size_t fusable_prefix()
+{
+    constexpr size_t n = sizeof...(P);
+    constexpr uint32_t reads[n] = {P::reads...};
+    constexpr uint32_t writes[n] = {P::writes...};
+
+    for (size_t i = 1; i < n; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (passes_conflict(reads[j], writes[j], reads[i], writes[i])) {
+                return i;
+            }
+        }
+    }
+    return n;
+}
+
+// Read and write masks of a pass, for the checks of the fusion rule below
+template <uint32_t R, uint32_t W>
+struct pass_masks {
+    static constexpr uint32_t reads = R;
+    static constexpr uint32_t writes = W;
+};
+
+using reads_objects = pass_masks<mod_kind(MOD_OBJECT), 0>;
+using writes_objects = pass_masks<0, mod_kind(MOD_OBJECT)>;
+using writes_types = pass_masks<0, mod_kind(MOD_TYPE)>;
+using reads_types = pass_masks<mod_kind(MOD_TYPE), 0>;
+using reads_types_writes_values = pass_masks<mod_kind(MOD_TYPE), mod_kind(MOD_EXPR_VALUE)>;
+
+static_assert(fusable_prefix<writes_types>() == 1);
+// Readers share a walk, and so do writers of different kinds
+static_assert(fusable_prefix<reads_objects, reads_objects>() == 2);
+static_assert(fusable_prefix<writes_types, writes_objects>() == 2);
+static_assert(fusable_prefix<reads_objects, reads_types_writes_values, reads_types>() == 3);
+// Read after write, write after read and write after write of a kind start a new walk
+static_assert(fusable_prefix<writes_types, reads_types>() == 1);
+static_assert(fusable_prefix<reads_objects, writes_objects>() == 1);
+static_assert(fusable_prefix<writes_objects, writes_objects>() == 1);
+// Conflict with any earlier pass of the group ends it, not only with the previous one
+static_assert(fusable_prefix<writes_types, writes_objects, reads_types_writes_values>() == 2);
+
+// Function bodies per parallel task
+constexpr size_t PASS_CHUNK_BODIES = 256;
+
+/**
+ * Output of a part of a walk, captured to be printed in walk order. Passes of the part print to
+ * the context. Marks are output positions between walked bodies.
+ */
+struct walk_output {
+    context ctx;
+    bool captured = false;
+
+    char *debug_buf = nullptr;
+    size_t debug_size = 0;
+    char *error_buf = nullptr;
+    size_t error_size = 0;
+
+    std::vector<size_t> debug_marks;
+    std::vector<size_t> error_marks;
+
+    walk_output() = default;
+    walk_output(const walk_output &) = delete;
+    walk_output &operator=(const walk_output &) = delete;
+    ~walk_output();
+};
+
+// Context of the output prints to the buffers, or to the streams of ctx if they cannot be created
+void begin_output(walk_output *out, const context *ctx);
+void mark_output(walk_output *out);
+void end_output(walk_output *out);
+
+// Print output of the walk with body outputs inserted at its marks. Bodies of every part have a
+// mark after each, parts are in walk order.
+void print_walk_output(context *ctx,
+        const walk_output *walk,
+        const std::vector<std::unique_ptr<walk_output>> &parts);
+
+/**
+ * Fused walk of a group of independent passes. Passes run in the order they are listed, post-order
+ * handlers too.
+ */
+template <typename... P>
+struct pass_group: static_visitor<pass_group<P...>> {
+    std::tuple<P...> passes;
+
+    // Function bodies are collected instead of walked, if set
+    std::vector<mod_body *> *deferred = nullptr;
+    walk_output *output = nullptr;
+
+    explicit pass_group(context *ctx): static_visitor<pass_group<P...>>(ctx), passes{P(ctx)...} {}
+
+    template <typename T>
+    void pre(T *e)
+    {
+        std::apply(
+                [e](auto &...p) {
+                    (pre_of(&p, e), ...);
+                },
+                passes);
+    }
+
+    template <typename T>
+    void post(T *e)
+    {
+        std::apply(
+                [e](auto &...p) {
+                    (post_of(&p, e), ...);
+                },
+                passes);
+    }
+
+    template <typename Pass, typename T>
+    static void pre_of(Pass *p, T *e)
+    {
+        if constexpr (has_pre<Pass, T>::value) {
+            p->pre(e);
+        }
+    }
+
+    template <typename Pass, typename T>
+    static void post_of(Pass *p, T *e)
+    {
+        if constexpr (has_post<Pass, T>::value) {
+            p->post(e);
+        }
+    }
+
+    template <typename T>
+    mod_node *visit_default(T *e)
+    {
+        pre(e);
+        visit_children(this, e);
+        post(e);
+        return nullptr;
+    }
+
+    // Top level definitions are timed one by one
+    template <typename T>
+    void visit_defs(arena_vector<T *> &list)
+    {
+        if (!this->root_ctx->trace) {
+            visit_list(this, list);
+            return;
+        }
+
+        for (size_t i = 0; i < list.size(); i++) {
+            trace_scope ts(this->root_ctx,
+                    "pass_def",
+                    symbol_name(this->root_ctx->symbols, list[i]->name));
+            visit_child(this, list[i]);
+        }
+    }
+
+    mod_node *visit_body(mod_body *e)
+    {
+        if (!deferred) {
+            return visit_default(e);
+        }
+        deferred->push_back(e);
+        mark_output(output);
+        return nullptr;
+    }
+
+    mod_node *visit_unit(mod_unit *e)
+    {
+        pre(e);
+        visit_defs(e->functions);
+        visit_defs(e->variables);
+        visit_defs(e->objects);
+        visit_defs(e->structs);
+        post(e);
+        return nullptr;
+    }
+
+    void begin_part(const pass_group &walk)
+    {
+        begin_part_of(walk, std::index_sequence_for<P...>());
+    }
+
+    template <size_t... I>
+    void begin_part_of(const pass_group &walk, std::index_sequence<I...>)
+    {
+        (std::get<I>(passes).begin_part(std::get<I>(walk.passes)), ...);
+    }
+
+    bool finish()
+    {
+        return std::apply(
+                [](auto &...p) {
+                    return (p.finish() & ...);
+                },
+                passes);
+    }
+};
+
+template <typename... P>
+bool run_pass_group_parallel(context *ctx, mod_unit *unit)
+{
+    // Everything but the bodies, in order
+    walk_output walk;
+    begin_output(&walk, ctx);
+    std::vector<mod_body *> bodies;
+    pass_group<P...> group(&walk.ctx);
+    group.deferred = &bodies;
+    group.output = &walk;
+    visit(&group, unit);
+    end_output(&walk);
+    bool result = group.finish();
+
+    const size_t n_parts = (bodies.size() + PASS_CHUNK_BODIES - 1) / PASS_CHUNK_BODIES;
+    std::vector<std::unique_ptr<walk_output>> parts(n_parts);
+    std::vector<uint8_t> part_results(n_parts, 0);
+    task_group tasks;
+    for (size_t i = 0; i < n_parts; i++) {
+        parts[i] = std::make_unique<walk_output>();
+        thread_pool_submit(ctx->pool, &tasks, [ctx, i, &group, &bodies, &parts, &part_results] {
+            {
+                trace_scope ts(ctx, "pass_bodies");
+                walk_output *out = parts[i].get();
+                begin_output(out, ctx);
+                pass_group<P...> part_group(&out->ctx);
+                part_group.begin_part(group);
+                size_t end = std::min(bodies.size(), (i + 1) * PASS_CHUNK_BODIES);
+                for (size_t j = i * PASS_CHUNK_BODIES; j < end; j++) {
+                    visit(&part_group, bodies[j]);
+                    mark_output(out);
+                }
+                end_output(out);
+                part_results[i] = part_group.finish();
+            }
+            // Task may run on a thread that compiles no file
+            if (ctx->trace) {
+                trace_flush(ctx->trace);
+            }
+        });
+    }
+    thread_pool_wait(ctx->pool, &tasks);
+
+    print_walk_output(ctx, &walk, parts);
+    for (uint8_t r : part_results) {
+        result = result && r;
+    }
+    return result;
+}
+
+template <typename... P>
+bool run_pass_group(context *ctx, mod_unit *unit)
+{
+    std::string names;
+    for (const char *name : {P::name...}) {
+        names += names.empty() ? "" : "+";
+        names += name;
+    }
+    trace_scope ts(ctx, "pass_group", names);
+
+    if constexpr ((P::independent_bodies && ...)) {
+        if (ctx->pool && unit->functions.size() > PASS_CHUNK_BODIES) {
+            return run_pass_group_parallel<P...>(ctx, unit);
+        }
+    }
+
+    pass_group<P...> group(ctx);
+    visit(&group, unit);
+    return group.finish();
+}
+
+template <typename... P>
+bool run_passes(context *ctx, mod_unit *unit);
+
+template <typename List, size_t... I, size_t... J>
+bool run_pass_split(
+        context *ctx, mod_unit *unit, std::index_sequence<I...>, std::index_sequence<J...>)
+{
+    constexpr size_t n = sizeof...(I);
+    return run_pass_group<std::tuple_element_t<I, List>...>(ctx, unit)
+            && run_passes<std::tuple_element_t<n + J, List>...>(ctx, unit);
+}
+
+// Run passes in the order they are listed, fusing independent neighbours. Stops at the first group
+// that fails.
+template <typename... P>
+bool run_passes(context *ctx, mod_unit *unit)
+{
+    if constexpr (sizeof...(P) == 0) {
+        return true;
+    } else {
+        constexpr size_t n = fusable_prefix<P...>();
+        return run_pass_split<std::tuple<P...>>(ctx,
+                unit,
+                std::make_index_sequence<n>(),
+                std::make_index_sequence<sizeof...(P) - n>());
+    }
+}
+
+} // owl
+
+#endif
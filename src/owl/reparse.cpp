@@ -0,0 +1,207 @@
+#include "owl/reparse.hpp"
+
+#include "owl/flat_model.hpp"
+#include "owl/lexer.hpp"
+#include "owl/trace.hpp"
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+namespace owl {
+
+// Code is compared in blocks first, bytes only in the block that differs
+constexpr size_t DIFF_BLOCK = 4096;
+
+static size_t common_prefix(std::string_view a, std::string_view b)
+{
+    const size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i + DIFF_BLOCK <= n && memcmp(a.data() + i, b.data() + i, DIFF_BLOCK) == 0) {
+        i += DIFF_BLOCK;
+    }
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+// Suffix shorter than limit
+static size_t common_suffix(std::string_view a, std::string_view b, size_t limit)
+{
+    const char *pa = a.data() + a.size();
+    const char *pb = b.data() + b.size();
+    size_t i = 0;
+    while (i + DIFF_BLOCK <= limit
+            && memcmp(pa - i - DIFF_BLOCK, pb - i - DIFF_BLOCK, DIFF_BLOCK) == 0) {
+        i += DIFF_BLOCK;
+    }
+    while (i < limit && pa[-(ptrdiff_t) i - 1] == pb[-(ptrdiff_t) i - 1]) {
+        i++;
+    }
+    return i;
+}
+
+// Add definition of the previous unit to the unit, moved by delta
+static void keep_def(mod_unit *unit,
+        const mod_unit *prev_unit,
+        def_range d,
+        int64_t delta,
+        std::vector<def_range> *defs)
+{
+    switch (d.kind) {
+    case MOD_FUNCTION:
+        unit->functions.push_back(prev_unit->functions[d.index]);
+        d.index = unit->functions.size() - 1;
+        break;
+    case MOD_VARIABLE:
+        unit->variables.push_back(prev_unit->variables[d.index]);
+        d.index = unit->variables.size() - 1;
+        break;
+    case MOD_OBJECT:
+        unit->objects.push_back(prev_unit->objects[d.index]);
+        d.index = unit->objects.size() - 1;
+        break;
+    default:
+        assert(false);
+    }
+
+    d.start += delta;
+    d.end += delta;
+    defs->push_back(d);
+}
+
+/**
+ * Parse definitions from offset start until the next token is the start of a previous definition
+ * at or after first_kept (moved by delta) or EOF. Returns index of that definition, or -1 on error.
+ */
+static ptrdiff_t parse_changed(context *ctx,
+        std::string_view code,
+        source_entry *source,
+        uint32_t start,
+        flat_span<def_range> prev_defs,
+        size_t first_kept,
+        int64_t delta,
+        arena *node_arena,
+        mod_unit *unit,
+        std::vector<def_range> *defs)
+{
+    // Errors are not reported, the code is parsed again in full
+    char *error_buf = nullptr;
+    size_t error_size = 0;
+    context quiet_ctx = *ctx;
+    quiet_ctx.f_error = open_memstream(&error_buf, &error_size);
+    quiet_ctx.f_debug = nullptr;
+    quiet_ctx.debug_lexer = false;
+    quiet_ctx.n_errors = 0;
+    if (!quiet_ctx.f_error) {
+        return -1;
+    }
+
+    // Lines are indexed separately, the lexer sees only part of the code
+    source_entry lex_source;
+    lex_source.base = source->base;
+    lex_source.size = source->size;
+
+    token_stream tokens;
+    token_stream_init(&tokens, &quiet_ctx, code, &lex_source);
+    tokens.lex.i = start;
+
+    size_t kept = first_kept;
+    bool ok = true;
+    while (ok) {
+        uint32_t stop = kept < prev_defs.size() ? prev_defs[kept].start + delta : UINT32_MAX;
+        ok = parse_defs(&quiet_ctx, node_arena, &tokens, stop, unit, defs);
+        if (!ok) {
+            break;
+        }
+
+        const token *t = peek_token(&tokens, 0);
+        if (t->tok == TOKEN_EOF) {
+            kept = prev_defs.size();
+            break;
+        }
+        while (kept < prev_defs.size() && prev_defs[kept].start + delta < t->offset) {
+            kept++;
+        }
+        if (kept < prev_defs.size() && prev_defs[kept].start + delta == t->offset) {
+            break;
+        }
+    }
+    ok = ok && !tokens.failed && quiet_ctx.n_errors == 0;
+
+    fclose(quiet_ctx.f_error);
+    free(error_buf);
+    return ok ? (ptrdiff_t) kept : -1;
+}
+
+mod_unit *reparse(context *ctx,
+        std::string_view code,
+        source_entry *source,
+        previous_model *prev,
+        arena *node_arena,
+        std::vector<def_range> *defs)
+{
+    const std::string_view prev_code = prev->code;
+    const auto &prev_defs = prev->defs;
+    if (code.size() > MAX_SOURCE_SIZE) {
+        return nullptr;
+    }
+
+    // Changed code is [prefix, prev_end) in the previous code and [prefix, end) in the new one
+    const size_t prefix = common_prefix(prev_code, code);
+    const size_t suffix = common_suffix(
+            prev_code, code, std::min(prev_code.size(), code.size()) - prefix);
+    const uint32_t prev_end = prev_code.size() - suffix;
+    const int64_t delta = (int64_t) code.size() - (int64_t) prev_code.size();
+
+    // Kept in full: last token and the byte after it did not change
+    size_t n_before = 0;
+    while (n_before < prev_defs.size() && prev_defs[n_before].end < prefix) {
+        n_before++;
+    }
+    // May be kept: whole definition is after the change
+    size_t first_after = n_before;
+    while (first_after < prev_defs.size() && prev_defs[first_after].start < prev_end) {
+        first_after++;
+    }
+
+    // Locations are relative to the code: offset + 1, nodes get them moved to the source
+    prev->model.shift_from = prev_end + 1;
+    prev->model.shift = delta;
+    prev->model.loc_delta = (int64_t) source->base - (NO_LOC + 1);
+    const mod_unit *prev_unit = expand(&prev->model, node_arena);
+
+    auto *unit = arena_new<mod_unit>(node_arena, node_arena);
+    unit->loc = prev_unit->loc;
+    for (size_t i = 0; i < n_before; i++) {
+        keep_def(unit, prev_unit, prev_defs[i], 0, defs);
+    }
+
+    const uint32_t start = n_before > 0 ? prev_defs[n_before - 1].end : 0;
+    ptrdiff_t kept = parse_changed(ctx,
+            code,
+            source,
+            start,
+            prev_defs,
+            first_after,
+            delta,
+            node_arena,
+            unit,
+            defs);
+    if (kept < 0) {
+        return nullptr;
+    }
+
+    for (size_t i = kept; i < prev_defs.size(); i++) {
+        keep_def(unit, prev_unit, prev_defs[i], delta, defs);
+    }
+
+    index_lines(code, &source->lines);
+    return unit;
+}
+
+} // owl
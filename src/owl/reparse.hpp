@@ -0,0 +1,39 @@
+#ifndef OWL_REPARSE_HPP
+#define OWL_REPARSE_HPP
+
+#include "owl/arena.hpp"
+#include "owl/context.hpp"
+#include "owl/model.hpp"
+#include "owl/model_cache.hpp"
+#include "owl/parser.hpp"
+#include "owl/source.hpp"
+
+#include <string_view>
+#include <vector>
+
+/**
+ * Incremental parsing. New code is compared with the code of the previous model: definitions
+ * before the first changed byte and after the last one are taken from the previous model, only
+ * the code in between is lexed and parsed. Parsing of the changed code continues until it reaches
+ * the start of a kept definition at a token boundary, so a change that extends into following
+ * definitions (an opened comment, a removed '}') is parsed just as a full parse would.
+ *
+ * Reparse is all or nothing: on any error nothing is reported and the caller parses the code in
+ * full, so diagnostics are always those of a full parse. Parser debug output is not printed for
+ * any definition.
+ */
+
+namespace owl {
+
+// Symbols of the previous model must be interned. Fills the line index of the source and the
+// ranges of all definitions of the returned unit.
+mod_unit *reparse(context *ctx,
+        std::string_view code,
+        source_entry *source,
+        previous_model *prev,
+        arena *node_arena,
+        std::vector<def_range> *defs);
+
+} // owl
+
+#endif
@@ -0,0 +1,205 @@
+#include "owl/arena.hpp"
+#include "owl/flat_model.hpp"
+#include "owl/lexer.hpp"
+#include "owl/model_cache.hpp"
+#include "owl/parser.hpp"
+#include "owl/reparse.hpp"
+#include "owl/source.hpp"
+#include "owl/symbols.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+#include <vector>
+
+using namespace owl;
+
+// Locations of the model are made relative to the code, as in the model cache, so models of
+// sources registered at different bases compare equal
+static bool parse_code(context *ctx,
+        arena *node_arena,
+        std::string_view code,
+        flat_model *m,
+        std::vector<def_range> *defs)
+{
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    token_stream tokens;
+    token_stream_init(&tokens, ctx, code, source);
+    mod_unit *unit = parse(ctx, node_arena, &tokens, defs);
+    bool ok = unit && !tokens.failed && ctx->n_errors == 0 && flatten(unit, m);
+    if (ok) {
+        rebase_model(m, source->base, NO_LOC + 1);
+    }
+    remove_source(global_sources(), source);
+    return ok;
+}
+
+// Code is parsed against the model of prev_code, returns false if reparse gave up
+static bool reparse_code(context *ctx,
+        arena *node_arena,
+        std::string_view prev_code,
+        std::string_view code,
+        flat_model *m,
+        std::vector<def_range> *defs)
+{
+    flat_model prev_model;
+    std::vector<def_range> prev_defs;
+    if (!parse_code(ctx, node_arena, prev_code, &prev_model, &prev_defs)) {
+        return false;
+    }
+
+    previous_model prev;
+    prev.code = prev_code;
+    prev.model = view_model(&prev_model);
+    prev.defs = prev_defs;
+
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    mod_unit *unit = reparse(ctx, code, source, &prev, node_arena, defs);
+    bool ok = unit && flatten(unit, m);
+    if (ok) {
+        rebase_model(m, source->base, NO_LOC + 1);
+    }
+    remove_source(global_sources(), source);
+    return ok;
+}
+
+static void expect_same_as_parse(std::string_view prev_code, std::string_view code)
+{
+    context ctx;
+    ctx.f_debug = nullptr;
+    ctx.file_name = "reparse_test.owl";
+    symbol_table symbols;
+    ctx.symbols = &symbols;
+    arena node_arena;
+
+    flat_model reparsed;
+    std::vector<def_range> reparsed_defs;
+    ASSERT_TRUE(reparse_code(&ctx, &node_arena, prev_code, code, &reparsed, &reparsed_defs));
+
+    // Same symbol table, so symbol ids of both models are the same
+    flat_model parsed;
+    std::vector<def_range> parsed_defs;
+    ASSERT_TRUE(parse_code(&ctx, &node_arena, code, &parsed, &parsed_defs));
+
+    EXPECT_TRUE(equal_models(&reparsed, &parsed));
+    EXPECT_EQ(hash_model(&reparsed), hash_model(&parsed));
+    ASSERT_EQ(reparsed_defs.size(), parsed_defs.size());
+    for (size_t i = 0; i < parsed_defs.size(); i++) {
+        EXPECT_EQ(reparsed_defs[i].kind, parsed_defs[i].kind) << "definition " << i;
+        EXPECT_EQ(reparsed_defs[i].index, parsed_defs[i].index) << "definition " << i;
+        EXPECT_EQ(reparsed_defs[i].start, parsed_defs[i].start) << "definition " << i;
+        EXPECT_EQ(reparsed_defs[i].end, parsed_defs[i].end) << "definition " << i;
+    }
+}
+
+static const char *const CODE = R"(object pt {
+    var x = 0;
+    auto var y;
+}
+
+func f() {
+    return 1
+}
+
+var a = 2;
+
+# last
+func g(): int {
+    return 3
+}
+)";
+
+TEST(reparse, unchanged)
+{
+    expect_same_as_parse(CODE, CODE);
+}
+
+TEST(reparse, changed_body)
+{
+    expect_same_as_parse(CODE, R"(object pt {
+    var x = 0;
+    auto var y;
+}
+
+func f() {
+    return 12345
+}
+
+var a = 2;
+
+# last
+func g(): int {
+    return 3
+}
+)");
+}
+
+TEST(reparse, added_definition)
+{
+    expect_same_as_parse(CODE, R"(object pt {
+    var x = 0;
+    auto var y;
+}
+
+func f() {
+    return 1
+}
+
+var b = 7;
+object q {}
+
+var a = 2;
+
+# last
+func g(): int {
+    return 3
+}
+)");
+}
+
+TEST(reparse, removed_definition)
+{
+    expect_same_as_parse(CODE, R"(object pt {
+    var x = 0;
+    auto var y;
+}
+
+var a = 2;
+
+# last
+func g(): int {
+    return 3
+}
+)");
+}
+
+TEST(reparse, change_at_start)
+{
+    expect_same_as_parse(CODE, std::string("var z = 5;\n") + CODE);
+}
+
+TEST(reparse, change_at_end)
+{
+    expect_same_as_parse(CODE, std::string(CODE) + "var z = 5;\n");
+}
+
+// Definition is gone, its code is still there
+TEST(reparse, commented_out_definition)
+{
+    expect_same_as_parse(CODE, R"(object pt {
+    var x = 0;
+    auto var y;
+}
+
+# func f() {
+#     return 1
+# }
+
+var a = 2;
+
+# last
+func g(): int {
+    return 3
+}
+)");
+}
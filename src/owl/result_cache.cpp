@@ -0,0 +1,170 @@
+#include "owl/result_cache.hpp"
+
+#include "owl/symbols.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace owl {
+
+// "OWLR" read as little endian
+constexpr uint32_t RESULT_CACHE_MAGIC = 0x524c574f;
+constexpr uint32_t RESULT_CACHE_VERSION = 1;
+
+/**
+ * Cache file header, followed by file name, debug output and error output.
+ */
+struct result_header {
+    uint32_t magic = RESULT_CACHE_MAGIC;
+    uint32_t version = RESULT_CACHE_VERSION;
+    uint64_t source_size = 0;
+    uint64_t source_hash = 0;
+    uint64_t compiler_hash = 0;
+    uint64_t options = 0;
+    uint32_t result = 0;
+    uint32_t n_errors = 0;
+    uint64_t name_size = 0;
+    uint64_t debug_size = 0;
+    uint64_t error_size = 0;
+    // Of everything after the header, detects damaged files
+    uint64_t data_hash = 0;
+};
+
+static bool read_file(const char *file_name, std::string *data)
+{
+    FILE *f = fopen(file_name, "rb");
+    if (!f) {
+        return false;
+    }
+
+    char chunk[64 * 1024];
+    size_t n = 0;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) {
+        data->append(chunk, n);
+    }
+    bool ok = !ferror(f);
+    fclose(f);
+    return ok;
+}
+
+// Any rebuild of the compiler changes its binary, so the binary identifies the compiler version
+static uint64_t compiler_hash()
+{
+    static const uint64_t hash = [] {
+        std::string exe;
+        return read_file("/proc/self/exe", &exe) && !exe.empty() ? hash_content(exe) : 0;
+    }();
+    return hash;
+}
+
+bool make_result_key(context *ctx, std::string_view code, result_key *key)
+{
+    key->file_name = ctx->file_name;
+    key->source_size = code.size();
+    key->source_hash = hash_content(code);
+    key->compiler_hash = compiler_hash();
+    key->options = output_options(ctx);
+    return key->compiler_hash != 0;
+}
+
+// One file per source file name, a newer result replaces the older one
+static std::string result_cache_path(context *ctx, const result_key *key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.owlr", (unsigned long long) hash_string(key->file_name));
+    return ctx->result_cache_dir + "/" + name;
+}
+
+bool read_result_cache(context *ctx, const result_key *key, cached_result *r)
+{
+    std::string data;
+    if (!read_file(result_cache_path(ctx, key).c_str(), &data)
+            || data.size() < sizeof(result_header)) {
+        return false;
+    }
+
+    result_header h;
+    memcpy(&h, data.data(), sizeof(h));
+    std::string_view rest = std::string_view(data).substr(sizeof(h));
+
+    if (h.magic != RESULT_CACHE_MAGIC || h.version != RESULT_CACHE_VERSION
+            || h.source_size != key->source_size || h.source_hash != key->source_hash
+            || h.compiler_hash != key->compiler_hash || h.options != key->options
+            || h.name_size != key->file_name.size() || h.data_hash != hash_content(rest)) {
+        return false;
+    }
+    if (h.debug_size > rest.size() || h.error_size > rest.size()
+            || h.name_size + h.debug_size + h.error_size != rest.size()
+            || rest.substr(0, h.name_size) != key->file_name) {
+        return false;
+    }
+
+    r->result = h.result != 0;
+    r->n_errors = h.n_errors;
+    r->debug_output = std::string(rest.substr(h.name_size, h.debug_size));
+    r->error_output = std::string(rest.substr(h.name_size + h.debug_size));
+    return true;
+}
+
+// Written to a temporary file and renamed, so readers never see a partial file
+bool write_result_cache(context *ctx, const result_key *key, const cached_result *r)
+{
+    std::string rest = key->file_name + r->debug_output + r->error_output;
+
+    result_header h;
+    h.source_size = key->source_size;
+    h.source_hash = key->source_hash;
+    h.compiler_hash = key->compiler_hash;
+    h.options = key->options;
+    h.result = r->result ? 1 : 0;
+    h.n_errors = r->n_errors;
+    h.name_size = key->file_name.size();
+    h.debug_size = r->debug_output.size();
+    h.error_size = r->error_output.size();
+    h.data_hash = hash_content(rest);
+
+    std::string path = result_cache_path(ctx, key);
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkstemp(tmp_path.data());
+    if (fd < 0) {
+        return false;
+    }
+
+    bool ok = write(fd, &h, sizeof(h)) == (ssize_t) sizeof(h)
+            && write(fd, rest.data(), rest.size()) == (ssize_t) rest.size();
+    ok = close(fd) == 0 && ok;
+
+    if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+static bool same_key(const result_key *key1, const result_key *key2)
+{
+    return key1->file_name == key2->file_name && key1->source_size == key2->source_size
+            && key1->source_hash == key2->source_hash && key1->compiler_hash == key2->compiler_hash
+            && key1->options == key2->options;
+}
+
+bool find_result(result_store *s, const result_key *key, cached_result *r)
+{
+    std::lock_guard<std::mutex> lock(s->mutex);
+    auto it = s->entries.find(key->file_name);
+    if (it == s->entries.end() || !same_key(&it->second.first, key)) {
+        return false;
+    }
+    *r = it->second.second;
+    return true;
+}
+
+void store_result(result_store *s, const result_key *key, const cached_result *r)
+{
+    std::lock_guard<std::mutex> lock(s->mutex);
+    s->entries[key->file_name] = std::make_pair(*key, *r);
+}
+
+} // owl
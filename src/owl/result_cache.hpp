@@ -0,0 +1,56 @@
+#ifndef OWL_RESULT_CACHE_HPP
+#define OWL_RESULT_CACHE_HPP
+
+#include "owl/context.hpp"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+/**
+ * Result cache. Outcome of compiling a file (result, number of errors, debug and error output) is
+ * saved in a file of the cache directory. Next compilation of the file replays the saved output if
+ * nothing that affects it has changed: file name, source contents, compiler binary and output
+ * options of the context. Failures to read or write the cache are not errors.
+ */
+
+namespace owl {
+
+struct result_key {
+    std::string file_name;
+    uint64_t source_size = 0;
+    uint64_t source_hash = 0;
+    uint64_t compiler_hash = 0;
+    uint64_t options = 0;
+};
+
+struct cached_result {
+    bool result = false;
+    int n_errors = 0;
+    std::string debug_output;
+    std::string error_output;
+};
+
+/**
+ * In-memory results of a long running process, by file name. Shared by all threads.
+ */
+struct result_store {
+    std::mutex mutex;
+    std::unordered_map<std::string, std::pair<result_key, cached_result>> entries;
+};
+
+// Returns false if the compiler binary cannot be identified, results must not be cached then
+bool make_result_key(context *ctx, std::string_view code, result_key *key);
+
+bool read_result_cache(context *ctx, const result_key *key, cached_result *r);
+bool write_result_cache(context *ctx, const result_key *key, const cached_result *r);
+
+bool find_result(result_store *s, const result_key *key, cached_result *r);
+void store_result(result_store *s, const result_key *key, const cached_result *r);
+
+} // owl
+
+#endif
@@ -0,0 +1,124 @@
+#include "owl/scopes.hpp"
+
+#include <assert.h>
+
+#include <algorithm>
+
+namespace owl {
+
+static constexpr size_t SYMBOL_MAP_MIN_SLOTS = 64;
+
+// Symbol ids are dense, multiplication spreads neighbours over the table
+static size_t map_hash(symbol_id key)
+{
+    return (size_t) ((key * 0x9e3779b97f4a7c15ull) >> 32);
+}
+
+uint32_t map_get(const symbol_map *m, symbol_id key)
+{
+    if (m->slots.empty()) {
+        return NO_BINDING;
+    }
+
+    const size_t mask = m->slots.size() - 1;
+    size_t i = map_hash(key) & mask;
+    while (true) {
+        const symbol_map_slot &s = m->slots[i];
+        if (s.key == key) {
+            return s.value;
+        }
+        if (s.key == NO_SYMBOL) {
+            return NO_BINDING;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+static void insert(std::vector<symbol_map_slot> *slots, symbol_id key, uint32_t value)
+{
+    const size_t mask = slots->size() - 1;
+    size_t i = map_hash(key) & mask;
+    while ((*slots)[i].key != NO_SYMBOL) {
+        i = (i + 1) & mask;
+    }
+    (*slots)[i] = {key, value};
+}
+
+static void grow(symbol_map *m)
+{
+    std::vector<symbol_map_slot> slots(std::max(m->slots.size() * 2, SYMBOL_MAP_MIN_SLOTS));
+    for (const symbol_map_slot &s : m->slots) {
+        if (s.key != NO_SYMBOL) {
+            insert(&slots, s.key, s.value);
+        }
+    }
+    m->slots.swap(slots);
+}
+
+void map_set(symbol_map *m, symbol_id key, uint32_t value)
+{
+    if ((m->count + 1) * 2 > m->slots.size()) {
+        grow(m);
+    }
+
+    const size_t mask = m->slots.size() - 1;
+    size_t i = map_hash(key) & mask;
+    while (true) {
+        symbol_map_slot &s = m->slots[i];
+        if (s.key == key) {
+            s.value = value;
+            return;
+        }
+        if (s.key == NO_SYMBOL) {
+            s = {key, value};
+            m->count++;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+void push_scope(scope_table *t)
+{
+    t->scopes.push_back(t->bindings.size());
+}
+
+void pop_scope(scope_table *t)
+{
+    assert(!t->scopes.empty());
+    const uint32_t start = t->scopes.back();
+    t->scopes.pop_back();
+
+    // Innermost bindings are restored last
+    for (size_t i = t->bindings.size(); i > start; i--) {
+        const scope_binding &b = t->bindings[i - 1];
+        map_set(&t->heads, b.name, b.shadowed);
+    }
+    t->bindings.resize(start);
+}
+
+mod_node *bind_name(scope_table *t, symbol_id name, mod_node *def)
+{
+    const uint32_t start = t->scopes.empty() ? 0 : t->scopes.back();
+    const uint32_t head = map_get(&t->heads, name);
+    if (head != NO_BINDING && head >= start) {
+        return t->bindings[head].def;
+    }
+
+    t->bindings.push_back({name, head, def});
+    map_set(&t->heads, name, t->bindings.size() - 1);
+    return nullptr;
+}
+
+mod_node *lookup_name(const scope_table *t, symbol_id name)
+{
+    for (; t; t = t->parent) {
+        const uint32_t head = map_get(&t->heads, name);
+        if (head != NO_BINDING) {
+            return t->bindings[head].def;
+        }
+    }
+    return nullptr;
+}
+
+} // owl
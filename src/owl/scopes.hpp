@@ -0,0 +1,73 @@
+#ifndef OWL_SCOPES_HPP
+#define OWL_SCOPES_HPP
+
+#include "owl/model.hpp"
+#include "owl/symbols.hpp"
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Scoped symbol table. Names are bound on a stack of bindings, a flat open addressing map from
+ * symbol id to the innermost binding of the name makes lookup a single probe sequence however deep
+ * the scopes are nested. Binding a name remembers the binding it shadows; popping a scope truncates
+ * the stack and restores shadowed bindings, so no map entry is ever removed.
+ *
+ * Tables may be chained to a parent that is searched for names not bound in the table. Lookups are
+ * read-only, so one table filled with global definitions can be the parent of tables of several
+ * threads.
+ */
+
+namespace owl {
+
+// No binding in the table
+constexpr uint32_t NO_BINDING = UINT32_MAX;
+
+struct symbol_map_slot {
+    symbol_id key = NO_SYMBOL;
+    uint32_t value = NO_BINDING;
+};
+
+/**
+ * Open addressing hash map from symbol id to 32-bit value, linear probing. Size is a power of 2
+ * and at most half of the slots are used.
+ */
+struct symbol_map {
+    std::vector<symbol_map_slot> slots;
+    size_t count = 0;
+};
+
+// NO_BINDING if key is not in the map
+uint32_t map_get(const symbol_map *m, symbol_id key);
+void map_set(symbol_map *m, symbol_id key, uint32_t value);
+
+struct scope_binding {
+    symbol_id name = NO_SYMBOL;
+    // Binding of the name in an outer scope
+    uint32_t shadowed = NO_BINDING;
+    mod_node *def = nullptr;
+};
+
+struct scope_table {
+    // Innermost binding of every name that was ever bound
+    symbol_map heads;
+    std::vector<scope_binding> bindings;
+    // Start of every open scope in bindings, the outermost scope is always open
+    std::vector<uint32_t> scopes;
+
+    const scope_table *parent = nullptr;
+};
+
+void push_scope(scope_table *t);
+void pop_scope(scope_table *t);
+
+// Returns definition the name is already bound to in the innermost scope, nullptr if there is
+// none and the name is bound
+mod_node *bind_name(scope_table *t, symbol_id name, mod_node *def);
+// Innermost definition of the name in the table or its parents
+mod_node *lookup_name(const scope_table *t, symbol_id name);
+
+} // owl
+
+#endif
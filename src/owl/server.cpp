@@ -0,0 +1,390 @@
+#include "owl/server.hpp"
+
+#include "owl/driver.hpp"
+#include "owl/result_cache.hpp"
+#include "owl/thread_pool.hpp"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace owl {
+
+// "OWLS" read as little endian
+constexpr uint32_t SERVER_MAGIC = 0x534c574f;
+constexpr uint32_t SERVER_VERSION = 3;
+
+// Limit of strings and lists in a request, guards against garbage
+constexpr uint32_t MAX_REQUEST_ITEM = 1 << 20;
+
+// Client that sends nothing or reads no output for this long is dropped, so it cannot hold up
+// other clients
+constexpr int CLIENT_TIMEOUT_SECONDS = 10;
+
+// Response frames: kind, 32-bit size, data
+enum frame_t : uint8_t {
+    FRAME_STDOUT = 1,
+    FRAME_STDERR,
+    FRAME_EXIT, // 32-bit exit code, last frame
+};
+
+struct server_request {
+    std::string cwd;
+    bool debug_lexer = false;
+    std::string model_cache_dir;
+    std::string result_cache_dir;
+    std::string c_output_dir;
+    bool layout_report = false;
+    std::vector<std::string> files;
+};
+
+static bool write_all(int fd, const void *data, size_t size)
+{
+    const char *p = (const char *) data;
+    while (size > 0) {
+        // Client may be gone, that must not kill the server with SIGPIPE
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool read_all(int fd, void *data, size_t size)
+{
+    char *p = (char *) data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool write_u32(int fd, uint32_t v)
+{
+    return write_all(fd, &v, sizeof(v));
+}
+
+static bool write_string(int fd, std::string_view s)
+{
+    return write_u32(fd, s.size()) && write_all(fd, s.data(), s.size());
+}
+
+static bool read_u32(int fd, uint32_t *v)
+{
+    return read_all(fd, v, sizeof(*v));
+}
+
+static bool read_string(int fd, std::string *s)
+{
+    uint32_t size = 0;
+    if (!read_u32(fd, &size) || size > MAX_REQUEST_ITEM) {
+        return false;
+    }
+    s->resize(size);
+    return read_all(fd, s->data(), size);
+}
+
+static bool write_frame(int fd, frame_t kind, const void *data, size_t size)
+{
+    uint8_t k = kind;
+    return write_all(fd, &k, 1) && write_u32(fd, size) && write_all(fd, data, size);
+}
+
+static bool write_request(int fd, const server_request *r)
+{
+    bool ok = write_u32(fd, SERVER_MAGIC) && write_u32(fd, SERVER_VERSION)
+            && write_string(fd, r->cwd) && write_u32(fd, r->debug_lexer ? 1 : 0)
+            && write_string(fd, r->model_cache_dir) && write_string(fd, r->result_cache_dir)
+            && write_string(fd, r->c_output_dir) && write_u32(fd, r->layout_report ? 1 : 0)
+            && write_u32(fd, r->files.size());
+    for (size_t i = 0; ok && i < r->files.size(); i++) {
+        ok = write_string(fd, r->files[i]);
+    }
+    return ok;
+}
+
+static bool read_request(int fd, server_request *r)
+{
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    uint32_t debug_lexer = 0;
+    uint32_t layout_report = 0;
+    uint32_t n_files = 0;
+    bool ok = read_u32(fd, &magic) && magic == SERVER_MAGIC && read_u32(fd, &version)
+            && version == SERVER_VERSION && read_string(fd, &r->cwd)
+            && read_u32(fd, &debug_lexer) && read_string(fd, &r->model_cache_dir)
+            && read_string(fd, &r->result_cache_dir) && read_string(fd, &r->c_output_dir)
+            && read_u32(fd, &layout_report) && read_u32(fd, &n_files)
+            && n_files <= MAX_REQUEST_ITEM;
+    r->debug_lexer = debug_lexer != 0;
+    r->layout_report = layout_report != 0;
+
+    r->files.resize(ok ? n_files : 0);
+    for (size_t i = 0; ok && i < r->files.size(); i++) {
+        ok = read_string(fd, &r->files[i]);
+    }
+    return ok;
+}
+
+static bool make_address(const char *socket_path, sockaddr_un *addr)
+{
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr->sun_path)) {
+        return false;
+    }
+    strcpy(addr->sun_path, socket_path);
+    return true;
+}
+
+static std::string absolute_path(const std::string &path)
+{
+    char cwd[PATH_MAX];
+    if (path.empty() || path[0] == '/' || !getcwd(cwd, sizeof(cwd))) {
+        return path;
+    }
+    return std::string(cwd) + "/" + path;
+}
+
+static void set_timeouts(int fd)
+{
+    timeval tv = {};
+    tv.tv_sec = CLIENT_TIMEOUT_SECONDS;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+// Path may be left behind by a server that was killed. Anything but a socket is never removed, and
+// neither is the socket of a server that is running.
+static bool claim_socket_path(const char *socket_path, const sockaddr_un *addr)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0) {
+        bool running = connect(fd, (const sockaddr *) addr, sizeof(*addr)) == 0;
+        close(fd);
+        if (running) {
+            fprintf(stderr, "Server is already running on '%s'\n", socket_path);
+            return false;
+        }
+    }
+
+    struct stat st = {};
+    if (lstat(socket_path, &st) != 0) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        fprintf(stderr, "Cannot use '%s' as socket: %s\n", socket_path, strerror(errno));
+        return false;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        fprintf(stderr, "'%s' exists and is not a socket\n", socket_path);
+        return false;
+    }
+    if (unlink(socket_path) != 0) {
+        fprintf(stderr, "Failed to remove old socket '%s': %s\n", socket_path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+struct server_state {
+    context options;
+    thread_pool *pool = nullptr;
+    result_store results;
+};
+
+// Files are relative to the client's directory, requests are served one at a time so the server
+// can change into it
+static void serve_request(server_state *s, int fd)
+{
+    server_request r;
+    if (!read_request(fd, &r)) {
+        return;
+    }
+
+    int rc = 1;
+    bool connected = true;
+    if (chdir(r.cwd.c_str()) != 0) {
+        std::string msg = "Server cannot change to '" + r.cwd + "': " + strerror(errno) + "\n";
+        connected = write_frame(fd, FRAME_STDERR, msg.data(), msg.size());
+    } else {
+        context options = s->options;
+        options.debug_lexer = r.debug_lexer;
+        if (!r.model_cache_dir.empty()) {
+            options.model_cache_dir = r.model_cache_dir;
+        }
+        if (!r.result_cache_dir.empty()) {
+            options.result_cache_dir = r.result_cache_dir;
+        }
+        // Relative to the client's directory, as the files
+        options.c_output_dir = r.c_output_dir;
+        options.layout_report = r.layout_report;
+        options.results = &s->results;
+
+        // Output of a client that has gone or timed out is dropped, files are still compiled and
+        // cached
+        rc = compile_files(&options, r.files, s->pool, [fd, &connected](compile_job *job) {
+            connected = connected
+                    && write_frame(fd, FRAME_STDOUT, job->debug_buf, job->debug_size)
+                    && write_frame(fd, FRAME_STDERR, job->error_buf, job->error_size);
+        });
+        if (rc == 0 && connected) {
+            const char msg[] = "Compilation successful\n";
+            connected = write_frame(fd, FRAME_STDOUT, msg, sizeof(msg) - 1);
+        }
+    }
+
+    uint32_t code = rc;
+    if (connected) {
+        write_frame(fd, FRAME_EXIT, &code, sizeof(code));
+    }
+}
+
+int run_server(const char *socket_path, const context *options, int n_threads)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, &addr)) {
+        fprintf(stderr, "Socket path is too long: '%s'\n", socket_path);
+        return 1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Failed to create socket: %s\n", strerror(errno));
+        return 1;
+    }
+
+    if (!claim_socket_path(socket_path, &addr)) {
+        close(listen_fd);
+        return 1;
+    }
+    if (bind(listen_fd, (const sockaddr *) &addr, sizeof(addr)) != 0
+            || listen(listen_fd, 16) != 0) {
+        fprintf(stderr, "Failed to listen on '%s': %s\n", socket_path, strerror(errno));
+        close(listen_fd);
+        return 1;
+    }
+
+    thread_pool pool(n_threads);
+    server_state s;
+    s.options = *options;
+    s.options.pool = &pool;
+    s.pool = &pool;
+
+    // Server changes into the directory of every client
+    s.options.model_cache_dir = absolute_path(options->model_cache_dir);
+    s.options.result_cache_dir = absolute_path(options->result_cache_dir);
+
+    fprintf(stderr, "Listening on '%s'\n", socket_path);
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            fprintf(stderr, "Failed to accept connection: %s\n", strerror(errno));
+            break;
+        }
+        set_timeouts(fd);
+        serve_request(&s, fd);
+        close(fd);
+    }
+
+    close(listen_fd);
+    return 1;
+}
+
+int run_client(
+        const char *socket_path, const context *options, const std::vector<std::string> &files)
+{
+    sockaddr_un addr;
+    if (!make_address(socket_path, &addr)) {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (connect(fd, (const sockaddr *) &addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    server_request r;
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd))) {
+        r.cwd = cwd;
+    }
+    r.debug_lexer = options->debug_lexer;
+    r.model_cache_dir = options->model_cache_dir;
+    r.result_cache_dir = options->result_cache_dir;
+    r.c_output_dir = options->c_output_dir;
+    r.layout_report = options->layout_report;
+    r.files = files;
+    if (!write_request(fd, &r)) {
+        close(fd);
+        return -1;
+    }
+
+    int rc = -1;
+    std::string data;
+    while (rc < 0) {
+        uint8_t kind = 0;
+        uint32_t size = 0;
+        if (!read_all(fd, &kind, 1) || !read_u32(fd, &size)) {
+            fprintf(stderr, "Connection to server '%s' lost\n", socket_path);
+            rc = 1;
+            break;
+        }
+        data.resize(size);
+        if (!read_all(fd, data.data(), size)) {
+            fprintf(stderr, "Connection to server '%s' lost\n", socket_path);
+            rc = 1;
+            break;
+        }
+
+        switch (kind) {
+        case FRAME_STDOUT:
+            fwrite(data.data(), 1, size, stdout);
+            fflush(stdout);
+            break;
+        case FRAME_STDERR:
+            fwrite(data.data(), 1, size, stderr);
+            break;
+        case FRAME_EXIT: {
+            uint32_t code = 1;
+            memcpy(&code, data.data(), std::min<size_t>(size, sizeof(code)));
+            rc = code;
+            break;
+        }
+        default:
+            break;
+        }
+    }
+
+    close(fd);
+    return rc;
+}
+
+} // owl
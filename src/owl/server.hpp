@@ -0,0 +1,28 @@
+#ifndef OWL_SERVER_HPP
+#define OWL_SERVER_HPP
+
+#include "owl/context.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * Compile server. A long running process listens on a Unix domain socket and compiles files for
+ * clients, keeping its worker threads and an in-memory result cache between requests, so files
+ * that did not change are not compiled again. Client sends its working directory, options and file
+ * list; server streams back output of the files in order and the exit code. Requests are served
+ * one at a time.
+ */
+
+namespace owl {
+
+// Runs until killed, returns exit code on failure to start
+int run_server(const char *socket_path, const context *options, int n_threads);
+
+// Returns exit code of the compilation, or -1 if server cannot be reached
+int run_client(
+        const char *socket_path, const context *options, const std::vector<std::string> &files);
+
+} // owl
+
+#endif
@@ -0,0 +1,165 @@
+#include "owl/source.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace owl {
+
+source_buffer::~source_buffer()
+{
+    if (map_addr) {
+        munmap(map_addr, map_size);
+    }
+}
+
+void find_line(const line_index *lines, uint32_t offset, int *lnum, int *cnum)
+{
+    const auto &starts = lines->starts;
+    auto it = std::upper_bound(starts.begin(), starts.end(), offset) - 1;
+    *lnum = (it - starts.begin()) + 1;
+    *cnum = offset - *it + 1;
+}
+
+void index_lines(std::string_view code, line_index *lines)
+{
+    lines->starts.assign(1, 0);
+    const char *p = code.data();
+    const char *end = code.data() + code.size();
+    while ((p = (const char *) memchr(p, '\n', end - p))) {
+        p++;
+        lines->starts.push_back(p - code.data());
+    }
+}
+
+source_manager *global_sources()
+{
+    static source_manager sm;
+    return &sm;
+}
+
+source_entry *add_source(source_manager *sm, std::string_view file_name, size_t size)
+{
+    std::lock_guard<std::mutex> lock(sm->mutex);
+
+    // One extra position for EOF
+    if (size >= UINT32_MAX - sm->next) {
+        return nullptr;
+    }
+
+    auto e = std::make_unique<source_entry>();
+    e->file_name = std::string(file_name);
+    e->base = sm->next;
+    e->size = size;
+    sm->next += size + 1;
+
+    sm->entries.push_back(std::move(e));
+    return sm->entries.back().get();
+}
+
+void remove_source(source_manager *sm, source_entry *e)
+{
+    std::lock_guard<std::mutex> lock(sm->mutex);
+
+    auto &entries = sm->entries;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (entries[i].get() == e) {
+            entries.erase(entries.begin() + i);
+            break;
+        }
+    }
+
+    // Reclaim the tail of address space
+    sm->next = entries.empty() ? NO_LOC + 1 : entries.back()->base + entries.back()->size + 1;
+}
+
+bool decode_loc(source_manager *sm, source_loc loc, std::string *file_name, int *lnum, int *cnum)
+{
+    std::lock_guard<std::mutex> lock(sm->mutex);
+
+    const auto &entries = sm->entries;
+    auto it = std::upper_bound(entries.begin(),
+            entries.end(),
+            loc,
+            [](source_loc loc, const std::unique_ptr<source_entry> &e) { return loc < e->base; });
+    if (it == entries.begin()) {
+        return false;
+    }
+
+    const source_entry *e = (--it)->get();
+    if (loc > e->base + e->size) {
+        return false;
+    }
+
+    *file_name = e->file_name;
+    find_line(&e->lines, loc - e->base, lnum, cnum);
+    return true;
+}
+
+static bool read_fd(context *ctx, const char *file_name, int fd, source_buffer *buf)
+{
+    char chunk[64 * 1024];
+    while (true) {
+        ssize_t n = read(fd, chunk, sizeof(chunk));
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            compiler_error(ctx, "failed to read file '%s': %s", file_name, strerror(errno));
+            return false;
+        }
+        buf->copy.append(chunk, n);
+    }
+    buf->data = buf->copy.data();
+    buf->size = buf->copy.size();
+    return true;
+}
+
+static bool map_fd(int fd, size_t size, source_buffer *buf)
+{
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        return false;
+    }
+    // Lexer reads the file once front to back
+    madvise(addr, size, MADV_SEQUENTIAL);
+
+    buf->map_addr = addr;
+    buf->map_size = size;
+    buf->data = (const char *) addr;
+    buf->size = size;
+    return true;
+}
+
+bool load_source(context *ctx, const char *file_name, source_buffer *buf)
+{
+    const bool is_stdin = strcmp(file_name, "-") == 0;
+
+    int fd = is_stdin ? STDIN_FILENO : open(file_name, O_RDONLY);
+    if (fd < 0) {
+        compiler_error(ctx, "failed to open file '%s': %s", file_name, strerror(errno));
+        return false;
+    }
+
+    struct stat st = {};
+    bool result = false;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+            && map_fd(fd, st.st_size, buf)) {
+        result = true;
+    } else {
+        // Pipe, empty file or mmap is not supported
+        result = read_fd(ctx, file_name, fd, buf);
+    }
+
+    if (!is_stdin) {
+        close(fd);
+    }
+    return result;
+}
+
+} // owl
@@ -0,0 +1,85 @@
+#ifndef OWL_SOURCE_HPP
+#define OWL_SOURCE_HPP
+
+#include "owl/context.hpp"
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Source code buffer. Regular files are memory mapped read-only, pipes and stdin (file name "-")
+ * are read into memory. Tokens and model nodes point into the buffer, so it must outlive them.
+ */
+
+namespace owl {
+
+struct source_buffer {
+    const char *data = nullptr;
+    size_t size = 0;
+
+    // Mapping, if file was mapped
+    void *map_addr = nullptr;
+    size_t map_size = 0;
+
+    // Contents, if file was read
+    std::string copy;
+
+    source_buffer() = default;
+    source_buffer(const source_buffer &) = delete;
+    source_buffer &operator=(const source_buffer &) = delete;
+    ~source_buffer();
+
+    std::string_view view() const { return std::string_view(data, size); }
+};
+
+// Positions in the code are 32-bit offsets
+constexpr size_t MAX_SOURCE_SIZE = UINT32_MAX;
+
+/**
+ * Offsets of line starts, filled by the lexer. Line and column of a position are computed only
+ * when needed, for diagnostics.
+ */
+struct line_index {
+    std::vector<uint32_t> starts{0};
+};
+
+void find_line(const line_index *lines, uint32_t offset, int *lnum, int *cnum);
+
+// Index of the whole code, for code that is not lexed from the start
+void index_lines(std::string_view code, line_index *lines);
+
+/**
+ * Source manager. Every code buffer being compiled is registered and gets a range in a single
+ * 32-bit address space, so any position in any file is one source_loc (base + offset). Ranges are
+ * reclaimed when sources are removed. Shared by all threads.
+ */
+struct source_entry {
+    std::string file_name;
+    source_loc base = NO_LOC;
+    uint32_t size = 0;
+    line_index lines;
+};
+
+struct source_manager {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<source_entry>> entries; // Sorted by base
+    source_loc next = NO_LOC + 1;
+};
+
+source_manager *global_sources();
+
+// Returns nullptr if address space is exhausted
+source_entry *add_source(source_manager *sm, std::string_view file_name, size_t size);
+void remove_source(source_manager *sm, source_entry *e);
+bool decode_loc(source_manager *sm, source_loc loc, std::string *file_name, int *lnum, int *cnum);
+
+bool load_source(context *ctx, const char *file_name, source_buffer *buf);
+
+} // owl
+
+#endif
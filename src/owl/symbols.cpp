@@ -0,0 +1,106 @@
+#include "owl/symbols.hpp"
+
+#include <string.h>
+
+namespace owl {
+
+static constexpr size_t SYMBOLS_MIN_SLOTS = 1024;
+
+symbol_table::symbol_table(): entries(1), slots(SYMBOLS_MIN_SLOTS, NO_SYMBOL) {}
+
+uint64_t hash_string(std::string_view s)
+{
+    // FNV-1a, identifiers are short
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (char c : s) {
+        h = (h ^ (uint8_t) c) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+// FNV-1a of hash_string takes a multiplication per byte, this takes one per 8 bytes in 4
+// independent lanes
+uint64_t hash_content(std::string_view s)
+{
+    const uint64_t k = 0x9e3779b97f4a7c15ull;
+    uint64_t lanes[4] = {k, k + 1, k + 2, k + 3};
+
+    size_t i = 0;
+    for (; i + 32 <= s.size(); i += 32) {
+        for (int j = 0; j < 4; j++) {
+            uint64_t w;
+            memcpy(&w, s.data() + i + 8 * j, 8);
+            lanes[j] = (lanes[j] ^ w) * k;
+            lanes[j] ^= lanes[j] >> 29;
+        }
+    }
+
+    uint64_t h = (s.size() ^ hash_string(s.substr(i))) * k;
+    for (int j = 0; j < 4; j++) {
+        h = (h ^ lanes[j]) * k;
+        h ^= h >> 32;
+    }
+    return h;
+}
+
+static void grow(symbol_table *t)
+{
+    const size_t mask = t->slots.size() * 2 - 1;
+    std::vector<symbol_id> slots(mask + 1, NO_SYMBOL);
+    for (symbol_id id = 1; id < t->entries.size(); id++) {
+        size_t i = t->entries[id].hash & mask;
+        while (slots[i] != NO_SYMBOL) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = id;
+    }
+    t->slots.swap(slots);
+}
+
+// Returns slot where symbol is or should be inserted
+static size_t find_slot(const symbol_table *t, std::string_view s, uint64_t h)
+{
+    const size_t mask = t->slots.size() - 1;
+    size_t i = h & mask;
+    while (true) {
+        const symbol_id id = t->slots[i];
+        if (id == NO_SYMBOL) {
+            return i;
+        }
+        const auto &e = t->entries[id];
+        if (e.hash == h && e.name == s) {
+            return i;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+symbol_id intern(symbol_table *t, std::string_view s)
+{
+    const uint64_t h = hash_string(s);
+    size_t i = find_slot(t, s, h);
+    if (t->slots[i] != NO_SYMBOL) {
+        return t->slots[i];
+    }
+
+    // Keep load factor under 1/2
+    if (t->entries.size() * 2 >= t->slots.size()) {
+        grow(t);
+        i = find_slot(t, s, h);
+    }
+
+    auto *copy = (char *) arena_alloc(&t->names, s.size(), 1);
+    memcpy(copy, s.data(), s.size());
+
+    const symbol_id id = t->entries.size();
+    t->entries.push_back(symbol_entry{std::string_view(copy, s.size()), h});
+    t->slots[i] = id;
+    return id;
+}
+
+symbol_id find_symbol(const symbol_table *t, std::string_view s)
+{
+    return t->slots[find_slot(t, s, hash_string(s))];
+}
+
+} // owl
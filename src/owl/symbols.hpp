@@ -0,0 +1,58 @@
+#ifndef OWL_SYMBOLS_HPP
+#define OWL_SYMBOLS_HPP
+
+#include "owl/arena.hpp"
+
+#include <stdint.h>
+
+#include <string_view>
+#include <vector>
+
+/**
+ * Symbol table (string interner). Maps every distinct identifier or literal to a 32-bit id, so
+ * names are compared and hashed as integers. Symbol text is copied into the table and stays valid
+ * for the table's lifetime. Interning is single threaded, lookups by id are read-only and may run
+ * concurrently once the table is filled.
+ */
+
+namespace owl {
+
+typedef uint32_t symbol_id;
+
+// Id 0 is reserved for "no symbol"
+constexpr symbol_id NO_SYMBOL = 0;
+
+struct symbol_entry {
+    std::string_view name;
+    uint64_t hash = 0;
+};
+
+struct symbol_table {
+    // String storage
+    arena names;
+
+    // Indexed by symbol id
+    std::vector<symbol_entry> entries;
+
+    // Open addressing hash table of symbol ids, size is a power of 2
+    std::vector<symbol_id> slots;
+
+    symbol_table();
+    symbol_table(const symbol_table &) = delete;
+    symbol_table &operator=(const symbol_table &) = delete;
+};
+
+uint64_t hash_string(std::string_view s);
+// Faster on long strings such as file contents
+uint64_t hash_content(std::string_view s);
+symbol_id intern(symbol_table *t, std::string_view s);
+symbol_id find_symbol(const symbol_table *t, std::string_view s);
+
+inline std::string_view symbol_name(const symbol_table *t, symbol_id id)
+{
+    return t->entries[id].name;
+}
+
+} // owl
+
+#endif
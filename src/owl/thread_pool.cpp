@@ -0,0 +1,145 @@
+#include "owl/thread_pool.hpp"
+
+namespace owl {
+
+// Pool and queue index of the worker running on this thread
+static thread_local thread_pool *current_pool = nullptr;
+static thread_local size_t current_worker = 0;
+
+static bool pop_back(task_queue *q, task_fn *task)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    if (q->tasks.empty()) {
+        return false;
+    }
+    *task = std::move(q->tasks.back());
+    q->tasks.pop_back();
+    return true;
+}
+
+static bool pop_front(task_queue *q, task_fn *task)
+{
+    std::lock_guard<std::mutex> lock(q->mutex);
+    if (q->tasks.empty()) {
+        return false;
+    }
+    *task = std::move(q->tasks.front());
+    q->tasks.pop_front();
+    return true;
+}
+
+// Own queue first, then the shared queue if allowed, then other workers' queues
+static bool take_task(thread_pool *pool, task_fn *task, bool take_shared)
+{
+    const bool is_worker = current_pool == pool;
+    const size_t n = pool->queues.size();
+    bool found = (is_worker && pop_back(pool->queues[current_worker].get(), task))
+            || (take_shared && pop_front(&pool->shared, task));
+    for (size_t i = 1; !found && i <= n; i++) {
+        size_t victim = ((is_worker ? current_worker : 0) + i) % n;
+        found = pop_front(pool->queues[victim].get(), task);
+    }
+    if (found) {
+        pool->n_queued--;
+    }
+    return found;
+}
+
+static void worker_main(thread_pool *pool, size_t index)
+{
+    current_pool = pool;
+    current_worker = index;
+    while (true) {
+        task_fn task;
+        if (take_task(pool, &task, true)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(pool->mutex);
+        pool->cv.wait(lock, [pool] { return pool->stop || pool->n_queued > 0; });
+        if (pool->stop && pool->n_queued == 0) {
+            return;
+        }
+    }
+}
+
+thread_pool::thread_pool(int n_threads)
+{
+    for (int i = 0; i < n_threads; i++) {
+        queues.push_back(std::make_unique<task_queue>());
+    }
+    for (int i = 0; i < n_threads; i++) {
+        workers.emplace_back(worker_main, this, i);
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    cv.notify_all();
+    for (auto &t : workers) {
+        t.join();
+    }
+}
+
+void thread_pool_submit(thread_pool *pool, task_fn task)
+{
+    task_queue *q = current_pool == pool ? pool->queues[current_worker].get() : &pool->shared;
+    {
+        // Counted before it is queued, so the count never drops below zero. Under the pool
+        // mutex, so a worker going to sleep does not miss it.
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->n_queued++;
+    }
+    {
+        std::lock_guard<std::mutex> lock(q->mutex);
+        q->tasks.push_back(std::move(task));
+    }
+    pool->cv.notify_one();
+}
+
+void thread_pool_submit(thread_pool *pool, task_group *group, task_fn task)
+{
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        group->n_pending++;
+    }
+    thread_pool_submit(pool, [group, task = std::move(task)] {
+        task();
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (--group->n_pending == 0) {
+            group->cv.notify_all();
+        }
+    });
+}
+
+void thread_pool_wait(thread_pool *pool, task_group *group)
+{
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(group->mutex);
+            if (group->n_pending == 0) {
+                return;
+            }
+        }
+
+        // Tasks of the shared queue are top-level jobs submitted from outside the pool; running one
+        // here would nest a whole job inside the waiting one and delay it until that job is done
+        task_fn task;
+        if (take_task(pool, &task, false)) {
+            task();
+            continue;
+        }
+
+        // Remaining tasks of the group are running on or queued for other threads
+        std::unique_lock<std::mutex> lock(group->mutex);
+        group->cv.wait(lock, [group] { return group->n_pending == 0; });
+        return;
+    }
+}
+
+} // owl
@@ -0,0 +1,67 @@
+#ifndef OWL_THREAD_POOL_HPP
+#define OWL_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed size work-stealing pool of worker threads. Every worker has a queue of its own: tasks
+ * submitted by a worker go to its queue and are taken back newest first, idle workers steal the
+ * oldest tasks of other queues. Tasks submitted from outside the pool go to a shared queue and run
+ * in FIFO order. Destructor waits for all submitted tasks to finish.
+ *
+ * Tasks may wait for tasks they submitted with a task group; a waiting thread runs tasks of the
+ * worker queues in the meantime, so nested waits do not starve the pool. It never takes tasks of
+ * the shared queue, which would run a whole top-level job nested inside the waiting one.
+ */
+
+namespace owl {
+
+typedef std::function<void()> task_fn;
+
+struct task_queue {
+    std::mutex mutex;
+    std::deque<task_fn> tasks;
+};
+
+struct thread_pool {
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<task_queue>> queues; // Indexed by worker
+    task_queue shared;
+
+    // Sleeping workers wait for queued tasks
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<size_t> n_queued{0};
+    bool stop = false;
+
+    explicit thread_pool(int n_threads);
+    thread_pool(const thread_pool &) = delete;
+    thread_pool &operator=(const thread_pool &) = delete;
+    ~thread_pool();
+};
+
+/**
+ * Tasks to wait for together.
+ */
+struct task_group {
+    std::mutex mutex;
+    std::condition_variable cv;
+    size_t n_pending = 0;
+};
+
+void thread_pool_submit(thread_pool *pool, task_fn task);
+void thread_pool_submit(thread_pool *pool, task_group *group, task_fn task);
+
+// Runs tasks of the worker queues, of any group, until all tasks of the group are done
+void thread_pool_wait(thread_pool *pool, task_group *group);
+
+} // owl
+
+#endif
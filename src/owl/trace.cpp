@@ -0,0 +1,176 @@
+#include "owl/trace.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <utility>
+
+namespace owl {
+
+static thread_local std::vector<trace_event> local_events;
+static thread_local std::string local_details;
+
+static uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+}
+
+static uint32_t thread_index()
+{
+    static std::atomic<uint32_t> next_index{1};
+    static thread_local uint32_t index = next_index++;
+    return index;
+}
+
+tracer::tracer(): files(1), start_ns{now_ns()} {}
+
+uint32_t add_trace_file(tracer *tr, std::string_view file_name)
+{
+    std::lock_guard<std::mutex> lock(tr->mutex);
+    tr->files.emplace_back(file_name);
+    return tr->files.size() - 1;
+}
+
+trace_scope::trace_scope(context *ctx, const char *name, std::string_view detail):
+        ctx{ctx}, name{name}, detail{detail}
+{
+    if (ctx->trace) {
+        start_ns = now_ns();
+    }
+}
+
+trace_scope::~trace_scope()
+{
+    if (!ctx->trace) {
+        return;
+    }
+
+    trace_event e;
+    e.name = name;
+    e.file = ctx->trace_file;
+    e.detail_start = local_details.size();
+    e.detail_size = detail.size();
+    local_details += detail;
+    e.start_ns = start_ns - ctx->trace->start_ns;
+    e.dur_ns = now_ns() - start_ns;
+    e.tid = thread_index();
+    local_events.push_back(e);
+}
+
+void trace_flush(tracer *tr)
+{
+    std::lock_guard<std::mutex> lock(tr->mutex);
+    const uint32_t details_start = tr->details.size();
+    for (auto e : local_events) {
+        e.detail_start += details_start;
+        tr->events.push_back(e);
+    }
+    tr->details += local_details;
+    local_events.clear();
+    local_details.clear();
+}
+
+static void write_json_string(FILE *f, std::string_view s)
+{
+    fputc('"', f);
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            fputc('\\', f);
+            fputc(c, f);
+        } else if ((uint8_t) c < 0x20) {
+            fprintf(f, "\\u%04x", c);
+        } else {
+            fputc(c, f);
+        }
+    }
+    fputc('"', f);
+}
+
+static void write_event(FILE *f, const tracer *tr, const trace_event *e, uint32_t pid)
+{
+    fprintf(f, ",\n{\"name\": ");
+    write_json_string(f, e->name);
+    fprintf(f,
+            ", \"cat\": \"owl\", \"ph\": \"X\", \"pid\": %u, \"tid\": %u, \"ts\": %.3f, "
+            "\"dur\": %.3f, \"args\": {",
+            pid,
+            e->tid,
+            e->start_ns / 1000.0,
+            e->dur_ns / 1000.0);
+    if (e->file) {
+        fprintf(f, "\"file\": ");
+        write_json_string(f, tr->files[e->file]);
+    }
+    if (e->detail_size) {
+        fprintf(f, "%s\"detail\": ", e->file ? ", " : "");
+        write_json_string(f, std::string_view(tr->details).substr(e->detail_start, e->detail_size));
+    }
+    fprintf(f, "}}");
+}
+
+static void write_process_name(FILE *f, uint32_t pid, std::string_view name)
+{
+    fprintf(f,
+            ",\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %u, "
+            "\"args\": {\"name\": ",
+            pid);
+    write_json_string(f, name);
+    fprintf(f,
+            "}},\n{\"name\": \"process_sort_index\", \"ph\": \"M\", \"pid\": %u, "
+            "\"args\": {\"sort_index\": %u}}",
+            pid,
+            pid);
+}
+
+// Events are on the track of their thread in process 1, and once more on the track of the
+// thread in the process of their file (file index + 1), so a file can be followed across threads
+bool write_trace(tracer *tr, const char *file_name)
+{
+    auto *f = fopen(file_name, "w");
+    if (!f) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(tr->mutex);
+
+    fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(f,
+            "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+            "\"args\": {\"name\": \"owl\"}}");
+    for (uint32_t i = 1; i < tr->files.size(); i++) {
+        write_process_name(f, i + 1, tr->files[i]);
+    }
+
+    // Tracks that have events, named after their thread
+    std::vector<std::pair<uint32_t, uint32_t>> tracks;
+    for (auto &e : tr->events) {
+        tracks.emplace_back(1, e.tid);
+        if (e.file) {
+            tracks.emplace_back(e.file + 1, e.tid);
+        }
+    }
+    std::sort(tracks.begin(), tracks.end());
+    tracks.erase(std::unique(tracks.begin(), tracks.end()), tracks.end());
+    for (auto &[pid, tid] : tracks) {
+        fprintf(f,
+                ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %u, \"tid\": %u, "
+                "\"args\": {\"name\": \"thread %u\"}}",
+                pid,
+                tid,
+                tid);
+    }
+
+    for (auto &e : tr->events) {
+        write_event(f, tr, &e, 1);
+        if (e.file) {
+            write_event(f, tr, &e, e.file + 1);
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    return fclose(f) == 0;
+}
+
+} // owl
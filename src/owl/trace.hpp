@@ -0,0 +1,66 @@
+#ifndef OWL_TRACE_HPP
+#define OWL_TRACE_HPP
+
+#include "owl/context.hpp"
+
+#include <stdint.h>
+
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * Compilation phase timers. Spans are recorded into a thread local buffer and handed over to the
+ * tracer by trace_flush(), then written as Chrome trace event JSON (chrome://tracing, Perfetto),
+ * with a track per thread and a process per file. Events refer to their file by index, details are
+ * appended to a text buffer of the thread, so recording allocates nothing per event.
+ * If context has no tracer, timers cost a pointer check.
+ */
+
+namespace owl {
+
+struct trace_event {
+    const char *name = nullptr;
+    uint32_t file = 0; // Index into tracer::files
+    // Range of the detail text of the thread, of tracer::details once flushed
+    uint32_t detail_start = 0;
+    uint32_t detail_size = 0;
+    uint64_t start_ns = 0;
+    uint64_t dur_ns = 0;
+    uint32_t tid = 0;
+};
+
+struct tracer {
+    std::mutex mutex;
+    std::vector<trace_event> events;
+    std::string details;
+    // Names of compiled files, index 0 is events of no file
+    std::vector<std::string> files;
+    uint64_t start_ns = 0;
+
+    tracer();
+};
+
+// Called once per compilation, events of contexts with the returned index are of the file
+uint32_t add_trace_file(tracer *tr, std::string_view file_name);
+
+struct trace_scope {
+    context *ctx = nullptr;
+    const char *name = nullptr;
+    std::string_view detail;
+    uint64_t start_ns = 0;
+
+    trace_scope(context *ctx, const char *name, std::string_view detail = std::string_view());
+    trace_scope(const trace_scope &) = delete;
+    trace_scope &operator=(const trace_scope &) = delete;
+    ~trace_scope();
+};
+
+// Move events of the calling thread to the tracer
+void trace_flush(tracer *tr);
+bool write_trace(tracer *tr, const char *file_name);
+
+} // owl
+
+#endif
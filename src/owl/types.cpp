@@ -0,0 +1,36 @@
+#include "owl/types.hpp"
+
+#include <assert.h>
+
+namespace owl {
+
+static const char *const BUILTIN_TYPES[] = {"bool", "byte", "int", "long", "float", "double"};
+
+static type_definition *new_type(type_table *t, symbol_id name, mod_node *def)
+{
+    auto *type = arena_new<type_definition>(&t->defs);
+    type->name = name;
+    type->id = t->types.size();
+    type->def = def;
+    t->types.push_back(type);
+    map_set(&t->names, name, type->id);
+    return type;
+}
+
+type_table::type_table(symbol_table *symbols)
+{
+    for (const char *name : BUILTIN_TYPES) {
+        new_type(this, intern(symbols, name), nullptr)->is_builtin = true;
+    }
+}
+
+type_definition *add_type(type_table *t, symbol_id name, mod_node *def)
+{
+    assert(!find_type(t, name));
+    auto *type = new_type(t, name, def);
+    // Objects are allocated on the heap, structs are values
+    type->is_ref = def->type == MOD_OBJECT;
+    return type;
+}
+
+} // owl
@@ -0,0 +1,53 @@
+#ifndef OWL_TYPES_HPP
+#define OWL_TYPES_HPP
+
+#include "owl/arena.hpp"
+#include "owl/model.hpp"
+#include "owl/scopes.hpp"
+#include "owl/symbols.hpp"
+
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Canonical type table. Every distinct type of a compilation, builtin or defined in the unit, has
+ * exactly one type_definition, which all mod_type nodes naming it link to, so types are compared
+ * by pointer or id. Types are added single threaded, lookups are read-only and may run
+ * concurrently.
+ */
+
+namespace owl {
+
+struct type_table {
+    // Owns type definitions
+    arena defs;
+
+    // Indexed by type id
+    std::vector<type_definition *> types;
+    // Type name to type id
+    symbol_map names;
+
+    // Builtin types are added up front, their names are interned in symbols
+    explicit type_table(symbol_table *symbols);
+    type_table(const type_table &) = delete;
+    type_table &operator=(const type_table &) = delete;
+};
+
+// Name must not be taken, def is the object or struct that defines the type
+type_definition *add_type(type_table *t, symbol_id name, mod_node *def);
+
+inline type_definition *find_type(const type_table *t, symbol_id name)
+{
+    const uint32_t id = map_get(&t->names, name);
+    return id != NO_BINDING ? t->types[id] : nullptr;
+}
+
+inline bool same_type(const mod_type *a, const mod_type *b)
+{
+    return a->type_def == b->type_def;
+}
+
+} // owl
+
+#endif
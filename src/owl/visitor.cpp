@@ -14,6 +14,12 @@ static void children_of_function(const visitor *v, void *bind, mod_function *nod
             node->data_type = (mod_type *) r;
         }
     }
+    if (node->body) {
+        auto *r = visit(v, bind, node->body);
+        if (r) {
+            node->body = (mod_body *) r;
+        }
+    }
 }
 
 static void children_of_variable(const visitor *v, void *bind, mod_variable *node)
@@ -53,6 +59,12 @@ static void children_of_type(const visitor *v, void *bind, mod_type *node)
 
 static void children_of_body(const visitor *v, void *bind, mod_body *node)
 {
+    for (size_t i = 0; i < node->statements.size(); i++) {
+        auto *r = visit(v, bind, node->statements[i]);
+        if (r) {
+            node->statements[i] = r;
+        }
+    }
 }
 
 static void children_of_stmt_return(const visitor *v, void *bind, mod_stmt_return *node)
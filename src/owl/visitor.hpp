@@ -9,7 +9,8 @@
 #include <vector>
 
 /**
- * Model tree visitor.
+ * Model tree visitors. visitor dispatches through a table of handlers filled in at run time,
+ * static_visitor is resolved at compile time and is preferred for passes over the whole model.
  */
 
 namespace owl {
@@ -28,6 +29,205 @@ struct visitor {
 void visit_children(const visitor *v, void *bind, mod_node *node);
 mod_node *visit(const visitor *v, void *bind, mod_node *node);
 
+/**
+ * Statically dispatched visitor. Pass derives from static_visitor<Pass>, keeps its state in its own
+ * fields and hides the handlers of the nodes it is interested in. Dispatch is a switch over node
+ * type resolved at compile time, so handlers and traversal can be inlined into a single function.
+ * Handler returning non-null replaces the visited node in its parent.
+ */
+
+template <typename Pass>
+mod_node *visit(Pass *p, mod_node *node);
+
+// Children of a known kind go straight to their handler, only those typed as mod_node or mod_expr
+// are dispatched by the switch
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_node *node)
+{
+    return visit(p, node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_function *node)
+{
+    return p->visit_function(node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_variable *node)
+{
+    return p->visit_variable(node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_object *node)
+{
+    return p->visit_object(node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_struct *node)
+{
+    return p->visit_struct(node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_type *node)
+{
+    return p->visit_type(node);
+}
+
+template <typename Pass>
+inline mod_node *visit_typed(Pass *p, mod_body *node)
+{
+    return p->visit_body(node);
+}
+
+template <typename Pass, typename T>
+inline void visit_child(Pass *p, T *&child)
+{
+    if (child) {
+        auto *r = visit_typed(p, child);
+        if (r) {
+            child = (T *) r;
+        }
+    }
+}
+
+template <typename Pass, typename T>
+inline void visit_list(Pass *p, arena_vector<T *> &list)
+{
+    for (size_t i = 0; i < list.size(); i++) {
+        visit_child(p, list[i]);
+    }
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_function *node)
+{
+    visit_child(p, node->data_type);
+    visit_child(p, node->body);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_variable *node)
+{
+    visit_child(p, node->data_type);
+    visit_child(p, node->init_expr);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_object *node)
+{
+    visit_list(p, node->fields);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_struct *node)
+{
+    // TODO
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_type *node)
+{
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_body *node)
+{
+    visit_list(p, node->statements);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_stmt_return *node)
+{
+    visit_child(p, node->expr);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_expr_apply *node)
+{
+    visit_child(p, node->data_type);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_expr_value *node)
+{
+    visit_child(p, node->data_type);
+}
+
+template <typename Pass>
+inline void visit_children(Pass *p, mod_unit *node)
+{
+    visit_list(p, node->functions);
+    visit_list(p, node->variables);
+    visit_list(p, node->objects);
+    visit_list(p, node->structs);
+}
+
+// Default handlers forward to visit_default, which visits children and keeps the node. Pass can
+// hide visit_default to handle all nodes the same way.
+template <typename Pass>
+struct static_visitor {
+    context *root_ctx = nullptr;
+
+    explicit static_visitor(context *ctx): root_ctx{ctx} {}
+
+    Pass *pass() { return static_cast<Pass *>(this); }
+
+    mod_node *visit_function(mod_function *e) { return pass()->visit_default(e); }
+    mod_node *visit_variable(mod_variable *e) { return pass()->visit_default(e); }
+    mod_node *visit_object(mod_object *e) { return pass()->visit_default(e); }
+    mod_node *visit_struct(mod_struct *e) { return pass()->visit_default(e); }
+    mod_node *visit_type(mod_type *e) { return pass()->visit_default(e); }
+    mod_node *visit_body(mod_body *e) { return pass()->visit_default(e); }
+    mod_node *visit_stmt_return(mod_stmt_return *e) { return pass()->visit_default(e); }
+    mod_node *visit_expr_apply(mod_expr_apply *e) { return pass()->visit_default(e); }
+    mod_node *visit_expr_value(mod_expr_value *e) { return pass()->visit_default(e); }
+    mod_node *visit_unit(mod_unit *e) { return pass()->visit_default(e); }
+
+    template <typename T>
+    mod_node *visit_default(T *e)
+    {
+        visit_children(pass(), e);
+        return nullptr;
+    }
+};
+
+template <typename Pass>
+inline mod_node *visit(Pass *p, mod_node *node)
+{
+    if (!node) {
+        return nullptr;
+    }
+
+    switch (node->type) {
+    case MOD_FUNCTION:
+        return p->visit_function((mod_function *) node);
+    case MOD_VARIABLE:
+        return p->visit_variable((mod_variable *) node);
+    case MOD_OBJECT:
+        return p->visit_object((mod_object *) node);
+    case MOD_STRUCT:
+        return p->visit_struct((mod_struct *) node);
+    case MOD_TYPE:
+        return p->visit_type((mod_type *) node);
+    case MOD_BODY:
+        return p->visit_body((mod_body *) node);
+    case MOD_STMT_RETURN:
+        return p->visit_stmt_return((mod_stmt_return *) node);
+    case MOD_EXPR_APPLY:
+        return p->visit_expr_apply((mod_expr_apply *) node);
+    case MOD_EXPR_VALUE:
+        return p->visit_expr_value((mod_expr_value *) node);
+    case MOD_UNIT:
+        return p->visit_unit((mod_unit *) node);
+    default:
+        return nullptr;
+    }
+}
+
 } // owl
 
 #endif
@@ -0,0 +1,104 @@
+#include "owl/arena.hpp"
+#include "owl/bench.hpp"
+#include "owl/flat_model.hpp"
+#include "owl/lexer.hpp"
+#include "owl/parser.hpp"
+#include "owl/symbols.hpp"
+
+using namespace owl;
+
+static mod_node *table_count_visit(const visitor *v, void *bind, mod_node *node)
+{
+    (*(size_t *) bind)++;
+    visit_children(v, bind, node);
+    return nullptr;
+}
+
+// Same traversal as count_nodes, dispatched through the handler table
+static size_t table_count_nodes(context *ctx, mod_node *node)
+{
+    visitor v(ctx);
+    for (int i = 0; i < MOD_SIZE; i++) {
+        v.visit[i] = &table_count_visit;
+    }
+
+    size_t n = 0;
+    visit(&v, &n, node);
+    return n;
+}
+
+static void flat_count_visit(const flat_visitor *v, void *bind, flat_node node)
+{
+    (*(size_t *) bind)++;
+    visit_children(v, bind, node);
+}
+
+// Same traversal over the flat model of the unit
+static size_t flat_count_nodes(context *ctx, const flat_view *m)
+{
+    flat_visitor v(ctx);
+    for (int i = 0; i < MOD_SIZE; i++) {
+        v.visit[i] = &flat_count_visit;
+    }
+
+    size_t n = 0;
+    visit(&v, &n, m);
+    return n;
+}
+
+// Traversal of the same model by all visitors. Results of the table and flat visitors are printed
+// here, the static one is returned to bench_main.
+static bool bench_visitor(context *ctx, std::string_view code, bench_result *r)
+{
+    source_entry *source = add_source(global_sources(), ctx->file_name, code.size());
+    arena node_arena;
+    symbol_table symbols;
+    ctx->symbols = &symbols;
+
+    token_stream tokens;
+    token_stream_init(&tokens, ctx, code, source);
+    mod_unit *unit = parse(ctx, &node_arena, &tokens);
+
+    bool result = false;
+    if (unit && !tokens.failed) {
+        bench_result table_r = *r;
+        table_r.bench = "visitor_table";
+        table_r.unit = "nodes";
+        result = bench_loop(&bench_opts, &table_r, [&]() -> size_t {
+            return table_count_nodes(ctx, unit);
+        });
+        if (result) {
+            print_bench(stdout, &table_r);
+        }
+
+        flat_model m;
+        bench_result flat_r = *r;
+        flat_r.bench = "visitor_flat";
+        flat_r.unit = "nodes";
+        result = result && flatten(unit, &m);
+        if (result) {
+            flat_view view = view_model(&m);
+            result = bench_loop(&bench_opts, &flat_r, [&]() -> size_t {
+                return flat_count_nodes(ctx, &view);
+            });
+        }
+        if (result) {
+            print_bench(stdout, &flat_r);
+        }
+
+        r->bench = "visitor_static";
+        r->unit = "nodes";
+        result = result && bench_loop(&bench_opts, r, [&]() -> size_t {
+            return count_nodes(ctx, unit);
+        });
+    }
+
+    remove_source(global_sources(), source);
+    ctx->symbols = nullptr;
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    return bench_main(argc, argv, "visitor", &bench_visitor);
+}